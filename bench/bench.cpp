@@ -0,0 +1,205 @@
+#define YISP_NO_MAIN
+#include "../lisp.cpp"
+
+#include <fstream>
+
+// Micro- and macro-benchmarks for the interpreter.
+// Every benchmark is run for a number of samples; each sample times a batch of
+// operations, and the median and p99 over all samples are written as JSON.
+//
+//   yisp_bench [--out file.json] [--samples N] [--filter name]
+//---------------------------------------------------------------------------------------------------------------------------------------
+using BenchClock = std::chrono::steady_clock;
+
+struct BenchResult {
+    std::string name;
+    std::string unit;
+    long opsPerSample;
+    std::vector<double> samples;
+};
+
+double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    size_t idx = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    return values[std::min(idx, values.size() - 1)];
+}
+
+// Times `body` once per sample and converts each sample to ns per operation
+BenchResult runTimed(const std::string& name, long ops, int samples, const std::function<void()>& body) {
+    BenchResult r{ name, "ns/op", ops, {} };
+    body();  // Warm up
+    for (int i = 0; i < samples; i++) {
+        auto start = BenchClock::now();
+        body();
+        double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+        r.samples.push_back(ns / ops);
+    }
+    return r;
+}
+
+// Like runTimed, but reports throughput of `bytes` per sample in MB/s
+BenchResult runThroughput(const std::string& name, size_t bytes, int samples, const std::function<void()>& body) {
+    BenchResult r{ name, "MB/s", 1, {} };
+    body();
+    for (int i = 0; i < samples; i++) {
+        auto start = BenchClock::now();
+        body();
+        double sec = std::chrono::duration<double>(BenchClock::now() - start).count();
+        r.samples.push_back(bytes / 1e6 / sec);
+    }
+    return r;
+}
+
+CellPtr evalString(const std::string& src, EnvironmentPtr env) {
+    return eval(read(src), env);
+}
+
+// Source for the reader benchmarks: many independent forms of mixed shape
+std::vector<std::string> readerCorpus(size_t& bytes) {
+    std::vector<std::string> lines;
+    bytes = 0;
+    for (int i = 0; i < 2000; i++) {
+        std::string line = "(define f" + std::to_string(i) + " (a b c) (if (gt a " + std::to_string(i) +
+                           ") (add (mul a b) (sub c 1)) (cons 'x (cons \"str\" (quote (1 2 3 4 5 6 7 8))))))";
+        bytes += line.size();
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+void writeJson(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << "    { \"name\": \"" << r.name << "\", \"unit\": \"" << r.unit << "\", \"ops_per_sample\": "
+            << r.opsPerSample << ", \"samples\": " << r.samples.size() << std::fixed << std::setprecision(3)
+            << ", \"median\": " << percentile(r.samples, 0.5) << ", \"p99\": " << percentile(r.samples, 0.99)
+            << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+        out.unsetf(std::ios::fixed);
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string outPath;
+    std::string filter;
+    int samples = 30;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) outPath = argv[++i];
+        else if (arg == "--samples" && i + 1 < argc) samples = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--filter" && i + 1 < argc) filter = argv[++i];
+    }
+
+    std::vector<std::pair<std::string, std::function<BenchResult()>>> benches;
+
+    // Reader throughput
+    size_t corpusBytes = 0;
+    std::vector<std::string> corpus = readerCorpus(corpusBytes);
+    benches.push_back({ "reader.tokenize", [&]() {
+        return runThroughput("reader.tokenize", corpusBytes, samples, [&]() {
+            for (auto& line : corpus) tokenize(line);
+        });
+    } });
+    benches.push_back({ "reader.read", [&]() {
+        return runThroughput("reader.read", corpusBytes, samples, [&]() {
+            for (auto& line : corpus) read(line);
+        });
+    } });
+    // The same forms loaded from fasl, reported against the size of their text
+    benches.push_back({ "reader.fasl", [&]() {
+        CellPtr all = std::make_shared<Cell>(List);
+        for (auto& line : corpus) all->mutableList().push_back(read(line));
+        std::string fasl = encodeFasl(all);
+        return runThroughput("reader.fasl", corpusBytes, samples, [&]() {
+            decodeFasl(fasl.data(), fasl.data() + fasl.size(), "corpus");
+        });
+    } });
+
+    // Primitive dispatch: global Proc path and the named builtin path
+    benches.push_back({ "dispatch.proc", [&]() {
+        auto env = createGlobalEnv();
+        CellPtr form = read("(+ 1 2)");
+        return runTimed("dispatch.proc", 100000, samples, [&]() {
+            for (int i = 0; i < 100000; i++) eval(form, env);
+        });
+    } });
+    benches.push_back({ "dispatch.builtin", [&]() {
+        auto env = createGlobalEnv();
+        CellPtr form = read("(add 1 2)");
+        return runTimed("dispatch.builtin", 100000, samples, [&]() {
+            for (int i = 0; i < 100000; i++) eval(form, env);
+        });
+    } });
+
+    // Macro benchmarks
+    benches.push_back({ "fib", [&]() {
+        auto env = createGlobalEnv();
+        evalString("(define fib (n) (if (lt n 2) n (add (fib (sub n 1)) (fib (sub n 2)))))", env);
+        CellPtr form = read("(fib 18)");
+        return runTimed("fib", 1, samples, [&]() { eval(form, env); });
+    } });
+    benches.push_back({ "tak", [&]() {
+        auto env = createGlobalEnv();
+        evalString("(define tak (x y z) (if (not (lt y x)) z (tak (tak (sub x 1) y z) (tak (sub y 1) z x) (tak (sub z 1) x y))))", env);
+        CellPtr form = read("(tak 18 12 6)");
+        return runTimed("tak", 1, samples, [&]() { eval(form, env); });
+    } });
+    benches.push_back({ "ackermann", [&]() {
+        auto env = createGlobalEnv();
+        evalString("(define ack (m n) (cond ((eq m 0) (add n 1)) ((eq n 0) (ack (sub m 1) 1)) (t (ack (sub m 1) (ack m (sub n 1))))))", env);
+        CellPtr form = read("(ack 2 9)");
+        return runTimed("ackermann", 1, samples, [&]() { eval(form, env); });
+    } });
+    benches.push_back({ "lists.cons_cdr", [&]() {
+        auto env = createGlobalEnv();
+        evalString("(define build (n acc) (if (eq n 0) acc (build (sub n 1) (cons n acc))))", env);
+        evalString("(define total (xs acc) (if (eq (car xs) 0) acc (total (cdr xs) (add acc (car xs)))))", env);
+        CellPtr form = read("(total (build 300 (quote (0))) 0)");
+        return runTimed("lists.cons_cdr", 1, samples, [&]() { eval(form, env); });
+    } });
+    // The same sum of squares of odd elements, by user recursion and by one fused pipeline
+    benches.push_back({ "lists.recursive_pipeline", [&]() {
+        auto env = createGlobalEnv();
+        evalString("(define build (n acc) (if (eq n 0) acc (build (sub n 1) (cons n acc))))", env);
+        evalString("(define sum-odd-sq (xs acc) (if (eq (car xs) 0) acc (sum-odd-sq (cdr xs) "
+                   "(if (eq (mod (car xs) 2) 1) (add acc (mul (car xs) (car xs))) acc))))", env);
+        evalString("(set xs (build 300 (quote (0))))", env);
+        CellPtr form = read("(sum-odd-sq xs 0)");
+        return runTimed("lists.recursive_pipeline", 1, samples, [&]() { eval(form, env); });
+    } });
+    benches.push_back({ "lists.fused_pipeline", [&]() {
+        auto env = createGlobalEnv();
+        evalString("(define build (n acc) (if (eq n 0) acc (build (sub n 1) (cons n acc))))", env);
+        evalString("(define odd (x) (eq (mod x 2) 1))", env);
+        evalString("(define sq (x) (mul x x))", env);
+        evalString("(set xs (build 300 (quote (0))))", env);
+        CellPtr form = read("(reduce + 0 (map sq (filter odd xs)))");
+        return runTimed("lists.fused_pipeline", 1, samples, [&]() { eval(form, env); });
+    } });
+    benches.push_back({ "closures", [&]() {
+        auto env = createGlobalEnv();
+        evalString("(define scale (k n) (if (define times-k (x) (mul x k)) (times-k n)))", env);
+        evalString("(define sum-scaled (n acc) (if (eq n 0) acc (sum-scaled (sub n 1) (add acc (scale 3 n)))))", env);
+        CellPtr form = read("(sum-scaled 500 0)");
+        return runTimed("closures", 1, samples, [&]() { eval(form, env); });
+    } });
+
+    std::vector<BenchResult> results;
+    for (auto& bench : benches) {
+        if (!filter.empty() && bench.first.find(filter) == std::string::npos) continue;
+        BenchResult r = bench.second();
+        std::cerr << std::left << std::setw(20) << r.name << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(14) << percentile(r.samples, 0.5) << " " << r.unit << "  (p99 "
+                  << percentile(r.samples, 0.99) << ")\n";
+        results.push_back(r);
+    }
+
+    if (outPath.empty()) {
+        writeJson(std::cout, results);
+    } else {
+        std::ofstream out(outPath);
+        writeJson(out, results);
+    }
+    return 0;
+}
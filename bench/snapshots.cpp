@@ -0,0 +1,164 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+// Replays a shared corpus through the repl() of every interpreter version and
+// reports latency and peak RSS side by side.
+//
+//   yisp_snapshots [--corpus file] [--repeat N] [--trials N] [--json file] name=binary ...
+//
+// The corpus is repeated N times into one stdin stream per run. Every version
+// is run `trials` times; the median wall time divided by the number of
+// expressions is the per-expression latency, RSS is the largest seen.
+//---------------------------------------------------------------------------------------------------------------------------------------
+struct Version {
+    std::string name;
+    std::string binary;
+    std::vector<double> seconds;
+    long maxRssKb = 0;
+    std::string status = "ok";
+};
+
+struct RunResult {
+    double seconds;
+    long maxRssKb;
+    int status;
+};
+
+RunResult runOnce(const std::string& binary, const std::string& inputPath) {
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error(std::string("fork failed: ") + std::strerror(errno));
+    }
+    if (pid == 0) {
+        int in = open(inputPath.c_str(), O_RDONLY);
+        int null = open("/dev/null", O_WRONLY);
+        if (in < 0 || null < 0) _exit(127);
+        dup2(in, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execl(binary.c_str(), binary.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return { seconds, usage.ru_maxrss, status };
+}
+
+std::string describeStatus(int status) {
+    if (WIFSIGNALED(status)) return std::string("crashed (") + strsignal(WTERMSIG(status)) + ")";
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 127) return "not runnable";
+    if (WIFEXITED(status) && WEXITSTATUS(status) != 0) return "exit " + std::to_string(WEXITSTATUS(status));
+    return "ok";
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char* argv[]) {
+    std::string corpusPath = "bench/corpus.yisp";
+    std::string jsonPath;
+    int repeat = 200;
+    int trials = 5;
+    std::vector<Version> versions;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--corpus" && i + 1 < argc) corpusPath = argv[++i];
+        else if (arg == "--repeat" && i + 1 < argc) repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--trials" && i + 1 < argc) trials = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--json" && i + 1 < argc) jsonPath = argv[++i];
+        else if (arg.find('=') != std::string::npos) {
+            Version v;
+            v.name = arg.substr(0, arg.find('='));
+            v.binary = arg.substr(arg.find('=') + 1);
+            versions.push_back(v);
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (versions.empty()) {
+        std::cerr << "usage: yisp_snapshots [--corpus file] [--repeat N] [--trials N] [--json file] name=binary ..." << std::endl;
+        return 1;
+    }
+
+    // Build the replay input once: the corpus repeated `repeat` times
+    std::ifstream corpusFile(corpusPath);
+    if (!corpusFile) {
+        std::cerr << "Cannot read corpus " << corpusPath << std::endl;
+        return 1;
+    }
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(corpusFile, line)) {
+        if (!line.empty()) lines.push_back(line);
+    }
+    char inputPath[] = "/tmp/yisp_corpusXXXXXX";
+    int fd = mkstemp(inputPath);
+    if (fd < 0) {
+        std::cerr << "Cannot create replay input" << std::endl;
+        return 1;
+    }
+    {
+        std::ofstream input(inputPath);
+        for (int r = 0; r < repeat; r++) {
+            for (auto& l : lines) input << l << '\n';
+        }
+    }
+    close(fd);
+    long expressions = static_cast<long>(lines.size()) * repeat;
+
+    for (auto& v : versions) {
+        for (int t = 0; t < trials; t++) {
+            RunResult r = runOnce(v.binary, inputPath);
+            v.seconds.push_back(r.seconds);
+            v.maxRssKb = std::max(v.maxRssKb, r.maxRssKb);
+            std::string status = describeStatus(r.status);
+            if (status != "ok") v.status = status;
+        }
+    }
+    unlink(inputPath);
+
+    std::cout << expressions << " expressions per run, " << trials << " trials\n";
+    std::cout << std::left << std::setw(12) << "version" << std::right << std::setw(16) << "us/expr"
+              << std::setw(14) << "total ms" << std::setw(14) << "max RSS KB" << "  status\n";
+    std::cout << std::fixed << std::setprecision(3);
+    for (auto& v : versions) {
+        double sec = median(v.seconds);
+        std::cout << std::left << std::setw(12) << v.name << std::right << std::setw(16) << sec * 1e6 / expressions
+                  << std::setw(14) << sec * 1e3 << std::setw(14) << v.maxRssKb << "  " << v.status << '\n';
+    }
+
+    if (!jsonPath.empty()) {
+        std::ofstream out(jsonPath);
+        out << std::fixed << std::setprecision(3);
+        out << "{\n  \"expressions\": " << expressions << ",\n  \"versions\": [\n";
+        for (size_t i = 0; i < versions.size(); i++) {
+            const Version& v = versions[i];
+            double sec = median(v.seconds);
+            out << "    { \"name\": \"" << v.name << "\", \"us_per_expr\": " << sec * 1e6 / expressions
+                << ", \"total_ms\": " << sec * 1e3 << ", \"max_rss_kb\": " << v.maxRssKb
+                << ", \"status\": \"" << v.status << "\" }" << (i + 1 < versions.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+    return 0;
+}
@@ -2,52 +2,408 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <set>
 #include <functional>
 #include <memory>
 #include <sstream>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <iomanip>
+#include <climits>
+#include <dlfcn.h>
+#include <cstring>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 ///////////////////////////////////////////////////-Environment and Cell Initialization-//////////////////////////////////////////////
-enum CellType { Symbol, Number, List, Proc, Lambda };
+// Native modules built by yispc include this file with YISP_MODULE defined. They keep
+// their own copy of the code but link the runtime state below against the interpreter.
+#ifdef YISP_MODULE
+#define YISP_SHARED extern
+#else
+#define YISP_SHARED
+#endif
+
+enum CellType { Symbol, Number, List, Proc, Lambda, Chan, Macro, Store, Promise, String };
 using CellPtr = std::shared_ptr<struct Cell>;
 using EnvironmentPtr = std::shared_ptr<struct Environment>;
 
 struct Environment;
 
-struct Cell {
-    CellType type;
-    std::string val;
-    std::vector<CellPtr> list;
+/////////////////////////////////////////////////////////////-HEAP ACCOUNTING-/////////////////////////////////////////////////////////
+// Counters are kept per thread so allocation stays cheap; a thread folds its
+// counters into retiredHeap when it exits. Frees on another thread than the
+// allocation only skew the per-thread numbers, never the merged totals.
+const int CellTypeCount = String + 1;
+
+struct HeapStats {
+    long liveCells[CellTypeCount] = {};
+    unsigned long totalCells[CellTypeCount] = {};
+    unsigned long cellsAllocated = 0;  // Sum of totalCells, read by the profiler
+    long liveEnvironments = 0;
+    unsigned long totalEnvironments = 0;
+    long stringBytes = 0;
+    long listBytes = 0;
+    long liveBytes = 0;
+    long peakBytes = 0;
+
+    void grow(long bytes) {
+        liveBytes += bytes;
+        if (liveBytes > peakBytes) peakBytes = liveBytes;
+    }
+};
+
+YISP_SHARED std::mutex heapMutex;
+YISP_SHARED HeapStats retiredHeap;
+
+void mergeHeap(HeapStats& into, const HeapStats& from) {
+    for (int i = 0; i < CellTypeCount; i++) {
+        into.liveCells[i] += from.liveCells[i];
+        into.totalCells[i] += from.totalCells[i];
+    }
+    into.cellsAllocated += from.cellsAllocated;
+    into.liveEnvironments += from.liveEnvironments;
+    into.totalEnvironments += from.totalEnvironments;
+    into.stringBytes += from.stringBytes;
+    into.listBytes += from.listBytes;
+    into.liveBytes += from.liveBytes;
+    into.peakBytes = std::max(into.peakBytes, from.peakBytes);
+}
+
+struct ThreadHeap {
+    HeapStats stats;
+
+    ~ThreadHeap() {
+        std::lock_guard<std::mutex> lock(heapMutex);
+        mergeHeap(retiredHeap, stats);
+    }
+};
+
+YISP_SHARED thread_local ThreadHeap threadHeap;
+
+// Bytes a string holds outside the Cell, zero while it fits the small-string buffer
+inline long stringHeapBytes(const std::string& s) {
+    static const size_t inlineCapacity = std::string().capacity();
+    return s.capacity() > inlineCapacity ? static_cast<long>(s.capacity() + 1) : 0;
+}
+
+// std::allocator that charges list storage to the current thread's heap counters
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator() = default;
+    template <typename U> CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        long bytes = static_cast<long>(n * sizeof(T));
+        threadHeap.stats.listBytes += bytes;
+        threadHeap.stats.grow(bytes);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        long bytes = static_cast<long>(n * sizeof(T));
+        threadHeap.stats.listBytes -= bytes;
+        threadHeap.stats.liveBytes -= bytes;
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U> bool operator==(const CountingAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const CountingAllocator<U>&) const { return false; }
+};
+
+using CellList = std::vector<CellPtr, CountingAllocator<CellPtr>>;
+
+// Native code for a Lambda: takes the arguments as longs, sets ctx->bail when it
+// cannot finish and the call has to be redone by the interpreter
+struct JitContext {
+    long bail;
+    long depth;
+};
+using JitFunction = long (*)(const long*, JitContext*);
+
+enum TierState { TierIdle, TierCompiling, TierReady, TierRejected };
+
+struct SpecNode;
+const size_t tierMaxParams = 16;
+
+// Per-Lambda state for the execution tiers, created by define
+struct LambdaData {
+    std::atomic<long> calls{0};
+    std::atomic<unsigned> argTypes[tierMaxParams] = {};  // Bit per CellType seen for each parameter
+    std::atomic<int> jitState{TierIdle};
+    JitFunction jitCode = nullptr;
+    size_t jitSize = 0;
+    std::atomic<int> specState{TierIdle};
+    std::unique_ptr<SpecNode> spec;
+    bool flatClosure = false;  // env holds only captured free variables; the call binds the name itself
+    bool usesBarrier = false;  // The body itself names a batch barrier form (isBarrierForm)
+
+    // What the body can do to the frame it runs in, for closures created inside it
+    std::once_flag frameInfoOnce;
+    bool rebindsFrame = false;          // Uses set, eval or load-native
+    std::set<std::string> frameDefines; // Names a define in the body may bind
+
+    ~LambdaData();
+};
+
+// Symbol names are interned: a Symbol Cell points at the one shared copy of its
+// name. Names are never freed, so the pointer stays valid for any Cell.
+const std::string* internSymbol(const std::string& name) {
+    static const std::string* const truth = new std::string("t");
+    static const std::string* const nil = new std::string("nil");
+    if (name == "t") return truth;
+    if (name == "nil") return nil;
+    thread_local std::unordered_map<std::string, const std::string*> seen;
+    auto it = seen.find(name);
+    if (it != seen.end()) return it->second;
+    static std::mutex namesMutex;
+    static std::unordered_set<std::string>* names = new std::unordered_set<std::string>();
+    std::lock_guard<std::mutex> lock(namesMutex);
+    const std::string* interned = &*names->insert(name).first;
+    seen.emplace(name, interned);
+    return interned;
+}
+
+// What a Cell holds out of line: everything but a symbol, a number or a list
+struct CellData {
+    std::string text;  // Name of a Proc, Lambda or Macro; characters of a flat String
+    CellList list;
     std::function<CellPtr(const std::vector<CellPtr>&)> proc;
     EnvironmentPtr env;
+    std::unique_ptr<LambdaData> lambda;
+    std::shared_ptr<struct Channel> channel;
+    std::shared_ptr<struct KeyValueStore> store;
+    size_t length = 0;  // Characters of a String rope; a flat String is just text
+};
+
+// A Cell is a type tag and one word-sized or list-sized payload, 32 bytes in all.
+// Numbers are held immediately, Symbols as an interned name, Lists inline; the
+// rarer kinds keep their fields in a CellData. The accessors hide the layout:
+// a field a type does not have reads as empty.
+struct Cell {
+    CellType type;
+    union {
+        long number;                // Number
+        const std::string* symbol;  // Symbol
+        CellList items;             // List
+        CellData* data;             // Proc, Lambda, Chan, Macro, Store, Promise, String
+    };
 
     // Existing Constructors
-    Cell(CellType type) : type(type), env(nullptr) {}
-    Cell(CellType type, const std::string& val) : type(type), val(val), env(nullptr) {}
-    Cell(std::function<CellPtr(const std::vector<CellPtr>&)> proc) : type(Proc), proc(proc), env(nullptr) {}
-    Cell(const std::vector<std::string>& args, CellPtr body, EnvironmentPtr env) : type(Lambda), env(env), list({body}) {}
+    Cell(CellType type) : type(type) { init(""); account(1); }
+    Cell(CellType type, const std::string& val) : type(type) { init(val); account(1); }
+    Cell(CellType type, long number) : type(type) {
+        init("");
+        if (type == Number) this->number = number;
+        account(1);
+    }
+    Cell(std::function<CellPtr(const std::vector<CellPtr>&)> proc) : type(Proc) {
+        init("");
+        data->proc = std::move(proc);
+        account(1);
+    }
+    Cell(const std::vector<std::string>& args, CellPtr body, EnvironmentPtr env) : type(Lambda) {
+        init("");
+        data->list.push_back(body);
+        data->env = env;
+        account(1);
+    }
 
     // New Constructor
-    Cell(CellType type, std::vector<CellPtr>& list, CellPtr& cell, EnvironmentPtr& env)
-        : type(type), list(list), proc(nullptr), env(env) {
-        // Additional setup if needed
+    Cell(CellType type, std::vector<CellPtr>& list, CellPtr& cell, EnvironmentPtr& env) : type(type) {
+        init("");
+        mutableList().assign(list.begin(), list.end());
+        if (hasData()) data->env = env;
+        account(1);
+    }
+
+    Cell(const Cell&) = delete;
+    Cell& operator=(const Cell&) = delete;
+
+    bool hasData() const { return type > List; }
+
+    const std::string& val() const {
+        if (type == Symbol) return *symbol;
+        return hasData() ? data->text : noText();
+    }
+    // Reading a field the Cell's type does not have gives an empty value; the
+    // mutable* accessors are for writing and throw for those types
+    const CellList& list() const {
+        if (type == List) return items;
+        return hasData() ? data->list : none<CellList>();
+    }
+    const std::function<CellPtr(const std::vector<CellPtr>&)>& proc() const {
+        return hasData() ? data->proc : none<std::function<CellPtr(const std::vector<CellPtr>&)>>();
+    }
+    const EnvironmentPtr& env() const { return hasData() ? data->env : none<EnvironmentPtr>(); }
+    const std::unique_ptr<LambdaData>& lambda() const { return hasData() ? data->lambda : none<std::unique_ptr<LambdaData>>(); }
+    const std::shared_ptr<struct Channel>& channel() const { return hasData() ? data->channel : none<std::shared_ptr<struct Channel>>(); }
+    const std::shared_ptr<struct KeyValueStore>& store() const { return hasData() ? data->store : none<std::shared_ptr<struct KeyValueStore>>(); }
+    size_t length() const { return hasData() ? data->length : 0; }
+
+    CellList& mutableList() {
+        if (type == List) return items;
+        return dataOf("list")->list;
+    }
+    std::function<CellPtr(const std::vector<CellPtr>&)>& mutableProc() { return dataOf("proc")->proc; }
+    EnvironmentPtr& mutableEnv() { return dataOf("env")->env; }
+    std::unique_ptr<LambdaData>& mutableLambda() { return dataOf("lambda")->lambda; }
+    std::shared_ptr<struct Channel>& mutableChannel() { return dataOf("channel")->channel; }
+    std::shared_ptr<struct KeyValueStore>& mutableStore() { return dataOf("store")->store; }
+    size_t& mutableLength() { return dataOf("length")->length; }
+
+    // Turns this Cell into a copy of the code in `from`, in place; used to expand
+    // the macro calls of code no one else holds yet
+    void become(const Cell& from) {
+        HeapStats& h = threadHeap.stats;
+        long before = payloadBytes();
+        long beforeText = textBytes();
+        CellList copied = from.list();  // Taken first: `from` may hang off this Cell's own list
+        std::string text = from.val();
+        h.liveCells[type]--;
+        destroy();
+        type = from.type;
+        init(text);
+        if (type == Number) number = from.number;
+        if (!copied.empty()) mutableList() = std::move(copied);
+        if (hasData()) data->length = from.data->length;
+        h.liveCells[type]++;
+        long after = payloadBytes();
+        h.stringBytes += textBytes() - beforeText;
+        h.grow(after - before);
+    }
+
+    ~Cell() {
+        account(-1);
+        destroy();
+    }
+
+private:
+    static const std::string& noText() {
+        static const std::string empty;
+        return empty;
+    }
+    // What a const accessor returns for a field the Cell's type does not have
+    template <typename T> static const T& none() {
+        static const T empty{};
+        return empty;
+    }
+
+    CellData* dataOf(const char* field) {
+        if (!hasData()) throw std::logic_error(std::string("Cell of type ") + std::to_string(type) + " has no " + field);
+        return data;
+    }
+
+    void init(const std::string& val) {
+        switch (type) {
+        case Number: number = val.empty() ? 0 : std::stol(val); break;
+        case Symbol: symbol = internSymbol(val); break;
+        case List: new (&items) CellList(); break;
+        default: data = new CellData(); data->text = val; break;
+        }
+    }
+
+    void destroy() {
+        if (type == List) {
+            if (!items.empty()) releaseChildren(items);
+            items.~CellList();
+        } else if (hasData()) {
+            if (!data->list.empty()) releaseChildren(data->list);
+            delete data;
+        }
+    }
+
+    // Children held only by this Cell are released from a loop instead of
+    // recursively, so dropping a deeply nested list cannot overflow the C++ stack
+    static void releaseChildren(CellList& list) {
+        static thread_local std::vector<CellPtr> pending;
+        static thread_local bool draining = false;
+        for (auto& c : list) {
+            if (c && c.use_count() == 1) pending.push_back(std::move(c));
+        }
+        if (draining) return;
+        draining = true;
+        while (!pending.empty()) {
+            CellPtr c = std::move(pending.back());
+            pending.pop_back();
+        }
+        draining = false;
+    }
+
+    long textBytes() const { return hasData() ? stringHeapBytes(data->text) : 0; }
+
+    // Bytes held beyond the Cell itself, list storage aside (the allocator counts that)
+    long payloadBytes() const { return hasData() ? static_cast<long>(sizeof(CellData)) + textBytes() : 0; }
+
+    // Charges (sign 1) or releases (sign -1) this Cell in the heap counters
+    void account(long sign) {
+        HeapStats& h = threadHeap.stats;
+        long bytes = static_cast<long>(sizeof(Cell)) + payloadBytes();
+        h.liveCells[type] += sign;
+        h.stringBytes += sign * textBytes();
+        if (sign > 0) {
+            h.totalCells[type]++;
+            h.cellsAllocated++;
+            h.grow(bytes);
+        } else {
+            h.liveBytes -= bytes;
+        }
     }
 };
 
+static_assert(sizeof(Cell) <= 32, "Cell should stay a tag and one list-sized payload");
+
 
 using Cells = std::vector<CellPtr>;
 
 struct Environment {
     std::map<std::string, CellPtr> symbols;
     EnvironmentPtr outer;
+    CellPtr owner;          // The Lambda whose call created this frame, if known
+    bool captured = false;  // Free variables copied for a flat closure; never changes
+
+    Environment(EnvironmentPtr outer = nullptr) : outer(outer) {
+        threadHeap.stats.liveEnvironments++;
+        threadHeap.stats.totalEnvironments++;
+        threadHeap.stats.grow(static_cast<long>(sizeof(Environment)));
+    }
 
-    Environment(EnvironmentPtr outer = nullptr) : outer(outer) {}
+    ~Environment() {
+        threadHeap.stats.liveEnvironments--;
+        threadHeap.stats.liveBytes -= static_cast<long>(sizeof(Environment));
+    }
 
     void define(const std::string& symbol, CellPtr value) {
         symbols[symbol] = value;
     }
 
+    // Like find(), but returns nullptr instead of throwing
+    CellPtr lookup(const std::string& symbol) {
+        for (Environment* e = this; e; e = e->outer.get()) {
+            auto it = e->symbols.find(symbol);
+            if (it != e->symbols.end()) return it->second;
+        }
+        return nullptr;
+    }
+
     CellPtr find(const std::string& symbol) {
-        if (symbols.find(symbol) != symbols.end())
-            return symbols[symbol];
+        auto it = symbols.find(symbol);
+        if (it != symbols.end())
+            return it->second;
         else if (outer)
             return outer->find(symbol);
         throw std::runtime_error("Symbol not found: " + symbol);
@@ -57,7 +413,11 @@ struct Environment {
 //////////////////////////////////////////////////////////////-PROCEDURES-////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 CellPtr makeNumber(long n) {
-    return std::make_shared<Cell>(Number, std::to_string(n));
+    return std::make_shared<Cell>(Number, n);
+}
+
+long numberValue(const CellPtr& cell) {
+    return cell->number;
 }
 
 bool isNumber(const std::string& s) {
@@ -70,7 +430,7 @@ bool isNumber(const std::string& s) {
 }
 
 bool isTrue(const CellPtr& cell) {
-    return !(cell->type == Symbol && cell->val == "nil");  // Only "nil" is false
+    return !(cell->type == Symbol && cell->val() == "nil");  // Only "nil" is false
 }
 
 CellPtr procAdd(const Cells& args) {
@@ -79,7 +439,7 @@ CellPtr procAdd(const Cells& args) {
         if (arg->type != Number) {
             throw std::runtime_error("Non-numeric operand in addition");
         }
-        result += std::stol(arg->val);
+        result += arg->number;
     }
     return makeNumber(result);
 }
@@ -93,7 +453,7 @@ CellPtr procSub(const Cells& args) {
         throw std::runtime_error("Non-numeric operand in subtraction (first argument)");
     }
 
-    long result = std::stol(args[0]->val);
+    long result = args[0]->number;
 
     if (args.size() == 1) {
         return makeNumber(-result);
@@ -103,7 +463,7 @@ CellPtr procSub(const Cells& args) {
         if (args[i]->type != Number) {
             throw std::runtime_error("Non-numeric operand in subtraction");
         }
-        result -= std::stol(args[i]->val);
+        result -= args[i]->number;
     }
 
     return makeNumber(result);
@@ -115,7 +475,7 @@ CellPtr procMul(const Cells& args) {
         if (arg->type != Number) {
             throw std::runtime_error("Non-numeric operand in multiplication");
         }
-        result *= std::stol(arg->val);
+        result *= arg->number;
     }
     return makeNumber(result);
 }
@@ -127,13 +487,13 @@ CellPtr procDiv(const Cells& args) {
     if (args[0]->type != Number) {
         throw std::runtime_error("Non-numeric operand in division");
     }
-    long result = std::stol(args[0]->val);
+    long result = args[0]->number;
 
     for (size_t i = 1; i < args.size(); i++) {
         if (args[i]->type != Number) {
             throw std::runtime_error("Non-numeric operand in division");
         }
-        long divisor = std::stol(args[i]->val);
+        long divisor = args[i]->number;
         if (divisor == 0) {
             throw std::runtime_error("Division by zero");
         }
@@ -149,8 +509,8 @@ CellPtr procMod(const Cells& args) {
     if (args[0]->type != Number || args[1]->type != Number) {
         throw std::runtime_error("Non-numeric operand in %");
     }
-    long num1 = std::stol(args[0]->val);
-    long num2 = std::stol(args[1]->val);
+    long num1 = args[0]->number;
+    long num2 = args[1]->number;
     if (num2 == 0) {
         throw std::runtime_error("Division by zero in %");
     }
@@ -161,7 +521,7 @@ CellPtr procGreaterThan(const Cells& args) {
     if (args.size() != 2 || args[0]->type != Number || args[1]->type != Number) {
         throw std::runtime_error("> requires exactly two numeric operands");
     }
-    return std::stol(args[0]->val) > std::stol(args[1]->val) ? 
+    return args[0]->number > args[1]->number ? 
            std::make_shared<Cell>(Symbol, "t") : std::make_shared<Cell>(Symbol, "nil");
 }
 
@@ -169,19 +529,26 @@ CellPtr procLessThan(const Cells& args) {
     if (args.size() != 2 || args[0]->type != Number || args[1]->type != Number) {
         throw std::runtime_error("< requires exactly two numeric operands");
     }
-    return std::stol(args[0]->val) < std::stol(args[1]->val) ? 
+    return args[0]->number < args[1]->number ? 
            std::make_shared<Cell>(Symbol, "t") : std::make_shared<Cell>(Symbol, "nil");
 }
 
+// Defined with the strings
+std::string stringText(const CellPtr& s);
+
 CellPtr procEquals(const Cells& args) {
     if (args.size() != 2) {
         throw std::runtime_error("= requires exactly two operands");
     }
-    if (args[0]->type == Number && args[1]->type == Number) {
-        return std::stol(args[0]->val) == std::stol(args[1]->val) ? 
-               std::make_shared<Cell>(Symbol, "t") : std::make_shared<Cell>(Symbol, "nil");
+    if (args[0]->type == Number || args[1]->type == Number) {
+        bool same = args[0]->type == args[1]->type && args[0]->number == args[1]->number;
+        return std::make_shared<Cell>(Symbol, same ? "t" : "nil");
     }
-    return (args[0]->val == args[1]->val) ? 
+    if (args[0]->type == String || args[1]->type == String) {
+        bool same = args[0]->type == args[1]->type && stringText(args[0]) == stringText(args[1]);
+        return std::make_shared<Cell>(Symbol, same ? "t" : "nil");
+    }
+    return (args[0]->val() == args[1]->val()) ? 
            std::make_shared<Cell>(Symbol, "t") : std::make_shared<Cell>(Symbol, "nil");
 }
 
@@ -189,14 +556,14 @@ CellPtr procGreaterEqual(const Cells& args) {
     if (args.size() != 2 || args[0]->type != Number || args[1]->type != Number) {
         throw std::runtime_error(">= requires exactly two numeric arguments");
     }
-    return std::make_shared<Cell>(Symbol, (args[0]->val >= args[1]->val) ? "t" : "nil");
+    return std::make_shared<Cell>(Symbol, (numberValue(args[0]) >= numberValue(args[1])) ? "t" : "nil");
 }
 
 CellPtr procLessEqual(const Cells& args) {
     if (args.size() != 2 || args[0]->type != Number || args[1]->type != Number) {
         throw std::runtime_error("<= requires exactly two numeric arguments");
     }
-    return std::make_shared<Cell>(Symbol, (args[0]->val <= args[1]->val) ? "t" : "nil");
+    return std::make_shared<Cell>(Symbol, (numberValue(args[0]) <= numberValue(args[1])) ? "t" : "nil");
 }
 
 CellPtr procNot(const Cells& args) {
@@ -235,7 +602,7 @@ CellPtr procSymbol(const Cells& args) {
     CellPtr arg = args[0];
     
     // A symbol is considered a `Symbol` type and not a `Number`
-    if (arg->type == Symbol && !(arg->val.empty() || isdigit(arg->val[0]))) {
+    if (arg->type == Symbol && !(arg->val().empty() || isdigit(arg->val()[0]))) {
         return std::make_shared<Cell>(Symbol, "t");
     }
     return std::make_shared<Cell>(Symbol, "nil");
@@ -263,11 +630,11 @@ CellPtr procCons(const Cells& args) {
 
     CellPtr result = std::make_shared<Cell>(List);
 
-    result->list.push_back(args[0]);
+    result->mutableList().push_back(args[0]);
 
     if (args[1]->type == List) {
-        result->list.insert(result->list.end(), args[1]->list.begin(), args[1]->list.end());
-    } else if (args[1]->type == Symbol && args[1]->val == "nil") {
+        result->mutableList().insert(result->list().end(), args[1]->list().begin(), args[1]->list().end());
+    } else if (args[1]->type == Symbol && args[1]->val() == "nil") {
     } else {
         throw std::runtime_error("cons requires the second argument to be a list or nil");
     }
@@ -277,18 +644,18 @@ CellPtr procCons(const Cells& args) {
 
 
 CellPtr procCar(const Cells& args) {
-    if (args.size() != 1 || args[0]->type != List || args[0]->list.empty()) {
+    if (args.size() != 1 || args[0]->type != List || args[0]->list().empty()) {
         throw std::runtime_error("car requires a non-empty list");
     }
-    return args[0]->list[0];
+    return args[0]->list()[0];
 }
 
 CellPtr procCdr(const Cells& args) {
-    if (args.size() != 1 || args[0]->type != List || args[0]->list.empty()) {
+    if (args.size() != 1 || args[0]->type != List || args[0]->list().empty()) {
         throw std::runtime_error("cdr requires a non-empty list");
     }
     CellPtr result = std::make_shared<Cell>(List);
-    result->list.insert(result->list.end(), args[0]->list.begin() + 1, args[0]->list.end());
+    result->mutableList().insert(result->list().end(), args[0]->list().begin() + 1, args[0]->list().end());
     return result;
 }
 
@@ -301,13 +668,273 @@ CellPtr procAtom(const Cells& args) {
     return (arg->type != List) ? std::make_shared<Cell>(Symbol, "t") : std::make_shared<Cell>(Symbol, "nil");
 }
 
+using Primitive = CellPtr (*)(const Cells&);
+
+// The numeric primitive that (op ...) with argc arguments calls when evaluated in env, or nullptr.
+// A symbol bound to a Proc gets all its arguments; the named builtins are dispatched by eval with
+// exactly two (one for not) and win over any user definition of the same name.
+Primitive numericPrimitive(const std::string& op, const EnvironmentPtr& env, size_t argc) {
+    static const std::pair<const char*, Primitive> named[] = {
+        { "add", procAdd }, { "sub", procSub }, { "mul", procMul }, { "div", procDiv }, { "mod", procMod },
+        { "gt", procGreaterThan }, { "lt", procLessThan }, { "eq", procEquals },
+        { "gte", procGreaterEqual }, { "lte", procLessEqual }, { "not", procNot }
+    };
+    CellPtr bound = env->lookup(op);
+    if (bound && bound->type == Proc) {
+        const Primitive* target = bound->proc().target<Primitive>();
+        for (auto& n : named) {
+            if (target && *target == n.second) return n.second;
+        }
+        return nullptr;
+    }
+    for (auto& n : named) {
+        if (op == n.first) return argc == (n.second == procNot ? 1u : 2u) ? n.second : nullptr;
+    }
+    return nullptr;
+}
+
+const char* cellTypeName(int type) {
+    static const char* names[CellTypeCount] = { "Symbol", "Number", "List", "Proc", "Lambda", "Chan", "Macro", "Store", "Promise",
+                                                  "String" };
+    return names[type];
+}
+
+// Counters of this thread plus every thread that has already exited
+HeapStats heapSnapshot() {
+    HeapStats total = threadHeap.stats;
+    std::lock_guard<std::mutex> lock(heapMutex);
+    mergeHeap(total, retiredHeap);
+    return total;
+}
+
+void heapReport(std::ostream& out, const HeapStats& h) {
+    long liveCells = 0;
+    out << std::left << std::setw(14) << "type" << std::right
+        << std::setw(12) << "live" << std::setw(14) << "total" << '\n';
+    for (int i = 0; i < CellTypeCount; i++) {
+        liveCells += h.liveCells[i];
+        out << std::left << std::setw(14) << cellTypeName(i) << std::right
+            << std::setw(12) << h.liveCells[i] << std::setw(14) << h.totalCells[i] << '\n';
+    }
+    out << std::left << std::setw(14) << "Environment" << std::right
+        << std::setw(12) << h.liveEnvironments << std::setw(14) << h.totalEnvironments << '\n';
+    out << "cell bytes:   " << liveCells * static_cast<long>(sizeof(Cell)) << '\n'
+        << "string bytes: " << h.stringBytes << '\n'
+        << "list bytes:   " << h.listBytes << '\n'
+        << "live bytes:   " << h.liveBytes << '\n'
+        << "peak bytes:   " << h.peakBytes << '\n';
+}
+
+CellPtr procRoom(const Cells& args) {
+    if (!args.empty()) {
+        throw std::runtime_error("room takes no arguments");
+    }
+    HeapStats h = heapSnapshot();
+    std::cout.flush();
+    heapReport(std::cerr, h);
+    long liveCells = 0;
+    for (int i = 0; i < CellTypeCount; i++) liveCells += h.liveCells[i];
+    return makeNumber(liveCells);
+}
+
 // Car and Cdr
 CellPtr cadr(const CellPtr& expr) {
-    return expr->list[1];
+    return expr->list()[1];
 }
 
 CellPtr caddr(const CellPtr& expr) {
-    return expr->list[2];
+    return expr->list()[2];
+}
+
+// Green threads, defined with the scheduler
+CellPtr procChan(const Cells& args);
+CellPtr procSend(const Cells& args);
+CellPtr procRecv(const Cells& args);
+CellPtr procYield(const Cells& args);
+
+// Persistent key-value stores, defined with the store
+CellPtr procStoreGet(const Cells& args);
+CellPtr procStorePut(const Cells& args);
+CellPtr procStoreDel(const Cells& args);
+CellPtr procStoreOpen(const Cells& args);
+
+// Promises and streams, defined with the streams
+CellPtr procForce(const Cells& args);
+CellPtr procStreamCar(const Cells& args);
+CellPtr procStreamCdr(const Cells& args);
+CellPtr procStreamMap(const Cells& args);
+CellPtr procStreamFilter(const Cells& args);
+
+// Sequence primitives, defined with the pipelines
+CellPtr procMap(const Cells& args);
+CellPtr procFilter(const Cells& args);
+CellPtr procReduce(const Cells& args);
+CellPtr procForEach(const Cells& args);
+
+// Data files and source files, defined with the fasl files and the loaders; the
+// loaders bind names in the global Environment they are given
+CellPtr procWriteFasl(const Cells& args);
+CellPtr procReadFasl(const Cells& args);
+CellPtr procLoadNative(const Cells& args, const EnvironmentPtr& global);
+CellPtr procWatch(const Cells& args, const EnvironmentPtr& global);
+CellPtr procLoad(const Cells& args, const EnvironmentPtr& global);
+
+///////////////////////////////////////////////////////////////-STRINGS-///////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// A "text" literal reads as a String Cell. A flat String keeps its text in val,
+// where std::string stores short values inline. string-append of long strings
+// builds a rope instead of copying: a String whose list holds a left and a
+// right String and whose length is the sum of theirs. Ropes are never changed
+// once built; their text is gathered with an explicit stack, so a rope grown
+// one append at a time is walked in time linear in its size.
+
+// Results shorter than this are copied flat; a rope's right leaf grows up to it
+const size_t ropeLeafBytes = 256;
+
+CellPtr makeString(const std::string& text) {
+    return std::make_shared<Cell>(String, text);
+}
+
+size_t stringLength(const Cell* s) {
+    return s->list().empty() ? s->val().size() : s->length();
+}
+
+// Appends the characters [from, to) of s to out
+void appendText(const Cell* s, size_t from, size_t to, std::string& out) {
+    struct Part {
+        const Cell* s;
+        size_t offset;  // Of its first character within the whole string
+    };
+    std::vector<Part> pending{ { s, 0 } };
+    while (!pending.empty()) {
+        Part part = pending.back();
+        pending.pop_back();
+        size_t end = part.offset + stringLength(part.s);
+        if (end <= from || part.offset >= to) continue;
+        if (part.s->list().empty()) {
+            size_t begin = std::max(from, part.offset);
+            out.append(part.s->val(), begin - part.offset, std::min(to, end) - begin);
+            continue;
+        }
+        const Cell* left = part.s->list()[0].get();
+        pending.push_back({ part.s->list()[1].get(), part.offset + stringLength(left) });
+        pending.push_back({ left, part.offset });
+    }
+}
+
+// The text of s: val itself when flat, otherwise gathered into scratch
+const std::string& stringText(const CellPtr& s, std::string& scratch) {
+    if (s->list().empty()) return s->val();
+    scratch.clear();
+    scratch.reserve(s->length());
+    appendText(s.get(), 0, s->length(), scratch);
+    return scratch;
+}
+
+std::string stringText(const CellPtr& s) {
+    std::string text;
+    return stringText(s, text);
+}
+
+CellPtr appendStrings(const CellPtr& a, const CellPtr& b) {
+    if (stringLength(b.get()) == 0) return a;
+    if (stringLength(a.get()) == 0) return b;
+    size_t length = stringLength(a.get()) + stringLength(b.get());
+    if (length < ropeLeafBytes) {
+        std::string text;
+        text.reserve(length);
+        appendText(a.get(), 0, stringLength(a.get()), text);
+        appendText(b.get(), 0, stringLength(b.get()), text);
+        return makeString(text);
+    }
+    auto rope = std::make_shared<Cell>(String);
+    rope->mutableLength() = length;
+    // Short pieces appended one by one are merged into the right leaf, not given a node each
+    const CellPtr& right = a->list().empty() ? nullptr : a->list()[1];
+    if (right && right->list().empty() && stringLength(right.get()) + stringLength(b.get()) < ropeLeafBytes) {
+        rope->mutableList().push_back(a->list()[0]);
+        rope->mutableList().push_back(appendStrings(right, b));
+    } else {
+        rope->mutableList().push_back(a);
+        rope->mutableList().push_back(b);
+    }
+    return rope;
+}
+
+const CellPtr& stringArgument(const Cells& args, size_t i, const char* what) {
+    if (i >= args.size() || args[i]->type != String) {
+        throw std::runtime_error(std::string(what) + " requires a string");
+    }
+    return args[i];
+}
+
+// File names are given as strings
+std::string pathArgument(const Cells& args, size_t i, const char* what) {
+    return stringText(stringArgument(args, i, what));
+}
+
+// An index argument in [0, limit]
+size_t indexArgument(const Cells& args, size_t i, size_t limit, const char* what) {
+    if (args[i]->type != Number) throw std::runtime_error(std::string(what) + " requires numeric positions");
+    long n = numberValue(args[i]);
+    if (n < 0 || static_cast<size_t>(n) > limit) {
+        throw std::runtime_error(std::string(what) + ": position " + std::to_string(n) + " is out of range");
+    }
+    return static_cast<size_t>(n);
+}
+
+CellPtr procString(const Cells& args) {
+    if (args.size() != 1) throw std::runtime_error("string? requires exactly one argument");
+    return std::make_shared<Cell>(Symbol, args[0]->type == String ? "t" : "nil");
+}
+
+CellPtr procStringAppend(const Cells& args) {
+    if (args.empty()) return makeString("");
+    CellPtr result = stringArgument(args, 0, "string-append");
+    for (size_t i = 1; i < args.size(); i++) result = appendStrings(result, stringArgument(args, i, "string-append"));
+    return result;
+}
+
+CellPtr procStringLength(const Cells& args) {
+    if (args.size() != 1) throw std::runtime_error("string-length requires exactly one argument");
+    return makeNumber(static_cast<long>(stringLength(stringArgument(args, 0, "string-length").get())));
+}
+
+// (substring s start [end]); end is exclusive and defaults to the length
+CellPtr procSubstring(const Cells& args) {
+    if (args.size() != 2 && args.size() != 3) throw std::runtime_error("substring requires a string, a start and an end");
+    const CellPtr& s = stringArgument(args, 0, "substring");
+    size_t length = stringLength(s.get());
+    size_t start = indexArgument(args, 1, length, "substring");
+    size_t end = args.size() == 3 ? indexArgument(args, 2, length, "substring") : length;
+    if (end < start) throw std::runtime_error("substring: end comes before start");
+    std::string text;
+    text.reserve(end - start);
+    appendText(s.get(), start, end, text);
+    return makeString(text);
+}
+
+CellPtr procStringToList(const Cells& args) {
+    if (args.size() != 1) throw std::runtime_error("string->list requires exactly one argument");
+    std::string scratch;
+    const std::string& text = stringText(stringArgument(args, 0, "string->list"), scratch);
+    auto result = std::make_shared<Cell>(List);
+    result->mutableList().reserve(text.size());
+    for (char c : text) result->mutableList().push_back(makeString(std::string(1, c)));
+    return result;
+}
+
+// (string-search pattern s [start]): the index of the first match at or after start, or nil
+CellPtr procStringSearch(const Cells& args) {
+    if (args.size() != 2 && args.size() != 3) throw std::runtime_error("string-search requires a pattern and a string");
+    std::string patternScratch, textScratch;
+    const std::string& pattern = stringText(stringArgument(args, 0, "string-search"), patternScratch);
+    const std::string& text = stringText(stringArgument(args, 1, "string-search"), textScratch);
+    size_t start = args.size() == 3 ? indexArgument(args, 2, text.size(), "string-search") : 0;
+    // glibc's memmem uses the two-way algorithm: linear time, no allocation
+    const void* found = memmem(text.data() + start, text.size() - start, pattern.data(), pattern.size());
+    if (!found) return std::make_shared<Cell>(Symbol, "nil");
+    return makeNumber(static_cast<const char*>(found) - text.data());
 }
 
 ///////////////////////////////////////////////////////////-Initialization in Global ENV-/////////////////////////////////////////////////////
@@ -333,6 +960,7 @@ EnvironmentPtr createGlobalEnv() {
     env->define("symbol?", std::make_shared<Cell>(procSymbol));
     env->define("list?", std::make_shared<Cell>(procList));
     env->define("nil?", std::make_shared<Cell>(procNil));
+    env->define("string?", std::make_shared<Cell>(procString));
     // t and nil symbols
     env->define("t", std::make_shared<Cell>(Symbol, "t"));   
     env->define("nil", std::make_shared<Cell>(Symbol, "nil")); 
@@ -344,6 +972,36 @@ EnvironmentPtr createGlobalEnv() {
     env->define("car", std::make_shared<Cell>(procCar));
     env->define("cdr", std::make_shared<Cell>(procCdr));
     env->define("atom", std::make_shared<Cell>(procAtom));
+    env->define("room", std::make_shared<Cell>(procRoom));
+    env->define("chan", std::make_shared<Cell>(procChan));
+    env->define("send", std::make_shared<Cell>(procSend));
+    env->define("recv", std::make_shared<Cell>(procRecv));
+    env->define("yield", std::make_shared<Cell>(procYield));
+    env->define("store-get", std::make_shared<Cell>(procStoreGet));
+    env->define("store-put", std::make_shared<Cell>(procStorePut));
+    env->define("store-del", std::make_shared<Cell>(procStoreDel));
+    env->define("store-open", std::make_shared<Cell>(procStoreOpen));
+    env->define("write-fasl", std::make_shared<Cell>(procWriteFasl));
+    env->define("read-fasl", std::make_shared<Cell>(procReadFasl));
+    // Held weakly: the Environment owns these Cells
+    std::weak_ptr<Environment> global = env;
+    env->define("load-native", std::make_shared<Cell>([global](const Cells& args) { return procLoadNative(args, global.lock()); }));
+    env->define("watch", std::make_shared<Cell>([global](const Cells& args) { return procWatch(args, global.lock()); }));
+    env->define("load", std::make_shared<Cell>([global](const Cells& args) { return procLoad(args, global.lock()); }));
+    env->define("force", std::make_shared<Cell>(procForce));
+    env->define("stream-car", std::make_shared<Cell>(procStreamCar));
+    env->define("stream-cdr", std::make_shared<Cell>(procStreamCdr));
+    env->define("stream-map", std::make_shared<Cell>(procStreamMap));
+    env->define("stream-filter", std::make_shared<Cell>(procStreamFilter));
+    env->define("map", std::make_shared<Cell>(procMap));
+    env->define("filter", std::make_shared<Cell>(procFilter));
+    env->define("reduce", std::make_shared<Cell>(procReduce));
+    env->define("for-each", std::make_shared<Cell>(procForEach));
+    env->define("string-append", std::make_shared<Cell>(procStringAppend));
+    env->define("string-length", std::make_shared<Cell>(procStringLength));
+    env->define("substring", std::make_shared<Cell>(procSubstring));
+    env->define("string->list", std::make_shared<Cell>(procStringToList));
+    env->define("string-search", std::make_shared<Cell>(procStringSearch));
     env->define("set", std::make_shared<Cell>(Symbol, "set"));
     env->define("define", std::make_shared<Cell>(Symbol, "define"));
 
@@ -399,50 +1057,160 @@ std::vector<std::string> tokenize(const std::string& input) {
 
 CellPtr atom(const std::string& token) {
     if (token.size() >= 2 && token.front() == '"' && token.back() == '"') {
-        std::string inner_token = token.substr(1, token.size() - 2);  
-        if (isNumber(inner_token)) {
-            return makeNumber(std::stol(inner_token));
-        }
-        return std::make_shared<Cell>(Symbol, inner_token);  
+        return makeString(token.substr(1, token.size() - 2));
     }
     if (isNumber(token)) {
-        return makeNumber(std::stol(token));
+        errno = 0;
+        long n = std::strtol(token.c_str(), nullptr, 10);
+        if (errno == ERANGE) throw std::runtime_error("Number out of range: " + token);
+        return makeNumber(n);
     }
     return std::make_shared<Cell>(Symbol, token);
 }
 
 
 CellPtr readFromTokens(std::vector<std::string>& tokens);
+CellPtr readFromTokens(const std::vector<std::string>& tokens, size_t& pos);
 
 CellPtr read(const std::string& s) {
     auto tokens = tokenize(s);
     return readFromTokens(tokens);
 }
 
-CellPtr readFromTokens(std::vector<std::string>& tokens) {
-    if (tokens.empty()) throw std::runtime_error("Unexpected EOF");
-
-    std::string token = tokens[0];
-    tokens.erase(tokens.begin());
-
-    if (token == "(") {
-        auto L = std::make_shared<Cell>(List);
-        while (tokens[0] != ")") {
-            L->list.push_back(readFromTokens(tokens));
-        }
-        tokens.erase(tokens.begin());  
-        return L;
-    } else if (token == ")") {
-        throw std::runtime_error("Unexpected )");
-    } else if (token == "'") {
-        // Convert 'expression to (quote expression)
-        auto quotedExpr = std::make_shared<Cell>(List);
-        quotedExpr->list.push_back(std::make_shared<Cell>(Symbol, "quote"));
-        quotedExpr->list.push_back(readFromTokens(tokens));
-        return quotedExpr;
-    } else {
-        return atom(token);
+// Reads every top-level form in s, for source files holding more than one form
+std::vector<CellPtr> readAll(const std::string& s) {
+    auto tokens = tokenize(s);
+    std::vector<CellPtr> forms;
+    size_t pos = 0;
+    while (pos < tokens.size()) forms.push_back(readFromTokens(tokens, pos));
+    return forms;
+}
+
+// Takes input as it arrives and hands out the tokens of each top-level form as
+// soon as the form is complete: a form may span several lines and a line may
+// hold several forms. Bytes are cut into tokens, the same way tokenize() does,
+// exactly once, when they are fed.
+struct FormReader {
+    std::vector<std::string> tokens;  // Of the form not complete yet
+    std::string token;                // Being scanned
+    bool inString = false;
+    int depth = 0;
+    std::deque<std::vector<std::string>> complete;
+
+    void feed(const char* p, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            char c = p[i];
+            if (c == '"') {
+                if (inString) {
+                    token += c;
+                    push();
+                    inString = false;
+                } else {
+                    push();
+                    token += c;
+                    inString = true;
+                }
+            } else if (inString) {
+                token += c;
+            } else if (isspace(static_cast<unsigned char>(c))) {
+                push();
+            } else if (c == '(' || c == ')' || c == '\'') {
+                push();
+                token += c;
+                push();
+            } else {
+                token += c;
+            }
+        }
+    }
+
+    void feedLine(const std::string& line) {
+        feed(line.data(), line.size());
+        feed("\n", 1);
+    }
+
+    // True while a form has started but not ended
+    bool pending() const {
+        return !tokens.empty() || !token.empty() || inString;
+    }
+
+    bool next(std::vector<std::string>& form) {
+        if (complete.empty()) return false;
+        form = std::move(complete.front());
+        complete.pop_front();
+        return true;
+    }
+
+    void push() {
+        if (token.empty()) return;
+        if (token == "(") depth++;
+        else if (token == ")") depth--;
+        bool quote = token == "'";
+        tokens.push_back(std::move(token));
+        token.clear();
+        // A stray ) ends a form of its own, for readFromTokens to report
+        if (depth <= 0 && !quote) {
+            complete.push_back(std::move(tokens));
+            tokens.clear();
+            depth = 0;
+        }
+    }
+};
+
+// Reads the form starting at tokens[pos] and moves pos past it. Open lists are
+// kept on an explicit stack, so nesting depth is bounded by memory rather than
+// the C++ stack.
+CellPtr readFromTokens(const std::vector<std::string>& tokens, size_t& pos) {
+    struct Open {
+        CellPtr list;
+        bool quote;  // A (quote x) built for 'x, closed by its first element
+    };
+    std::vector<Open> open;
+    CellPtr form;
+
+    while (!form) {
+        if (pos >= tokens.size()) throw std::runtime_error("Unexpected EOF");
+        const std::string& token = tokens[pos++];
+
+        CellPtr value;
+        if (token == "(") {
+            open.push_back({ std::make_shared<Cell>(List), false });
+            continue;
+        } else if (token == ")") {
+            if (open.empty() || open.back().quote) throw std::runtime_error("Unexpected )");
+            value = open.back().list;
+            open.pop_back();
+        } else if (token == "'") {
+            // Convert 'expression to (quote expression)
+            auto quotedExpr = std::make_shared<Cell>(List);
+            quotedExpr->mutableList().push_back(std::make_shared<Cell>(Symbol, "quote"));
+            open.push_back({ quotedExpr, true });
+            continue;
+        } else {
+            value = atom(token);
+        }
+
+        // Hand the value to the innermost open list, closing finished quotes
+        while (!form) {
+            if (open.empty()) {
+                form = value;
+            } else {
+                open.back().list->mutableList().push_back(value);
+                if (!open.back().quote) break;
+                value = open.back().list;
+                open.pop_back();
+            }
+        }
     }
+    return form;
+}
+
+// Reads one form and removes its tokens
+CellPtr readFromTokens(std::vector<std::string>& tokens) {
+    size_t pos = 0;
+    CellPtr form = readFromTokens(tokens, pos);
+    tokens.erase(tokens.begin(), tokens.begin() + pos);
+    return form;
 }
 
 // Parallel lists for environment
@@ -452,7 +1220,7 @@ std::vector<CellPtr> valueTable;
 // Set a symbol to a value in the environment
 void set(const std::string& name, const CellPtr& value) {
     for (size_t i = 0; i < symbolTable.size(); ++i) {
-        if (symbolTable[i]->val == name) {
+        if (symbolTable[i]->val() == name) {
             valueTable[i] = value;
             return;
         }
@@ -464,228 +1232,3280 @@ void set(const std::string& name, const CellPtr& value) {
 // Lookup a symbol's value in the environment
 CellPtr lookup(const std::string& name) {
     for (size_t i = 0; i < symbolTable.size(); ++i) {
-        if (symbolTable[i]->val == name) {
+        if (symbolTable[i]->val() == name) {
             return valueTable[i];
         }
     }
     return std::make_shared<Cell>(Symbol, name); 
 }
 
-///////////////////////////////////////////////////////-EVAL-FX-//////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////-PROFILER-////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-CellPtr eval(CellPtr expr, EnvironmentPtr env) {
-    // If it's a number, return it directly
-    if (expr->type == Number) return expr;
-
-    // If it's a literal string (in quotes), return it directly
-    if (expr->type == Symbol && expr->val.size() >= 2 && expr->val.front() == '"' && expr->val.back() == '"') {
-        return expr;
-    }
+// Per-function counters; inclusive time and allocations are only charged to the
+// outermost active call so recursion is not counted twice
+struct ProfileEntry {
+    unsigned long calls = 0;
+    double inclusive = 0;
+    double exclusive = 0;
+    unsigned long allocs = 0;
+    unsigned long selfAllocs = 0;
+    int active = 0;
+};
 
-    // Lookup symbols in the environment
-    if (expr->type == Symbol) return env->find(expr->val);
+using ProfileTable = std::map<std::string, ProfileEntry>;
+using ProfileClock = std::chrono::steady_clock;
 
-    // Return empty lists as-is
-    if (expr->list.empty()) return expr;
+struct ProfileFrame {
+    ProfileEntry* entry;
+    ProfileClock::time_point start;
+    double childTime;
+    unsigned long startAllocs;
+    unsigned long childAllocs;
+};
 
-    CellPtr first = expr->list[0]; // First element in the list (function or special form)
+// Per thread like the tables: (profile ...) on one batch worker must not time the
+// forms the others run. Workers start with the setting of the thread that made them.
+YISP_SHARED thread_local bool profilingEnabled;
 
-    // Handle global operators 
-    if (first->type == Symbol && env->symbols.count(first->val)) {
-        std::string funcName = first->val;
-        CellPtr proc = env->find(funcName);
+YISP_SHARED std::mutex profileMutex;
+YISP_SHARED ProfileTable retiredProfile;  // Tables of worker threads that have exited
 
-        if (proc->type == Proc) {
-            Cells args;
-            for (size_t i = 1; i < expr->list.size(); i++) {
-                args.push_back(eval(expr->list[i], env));
-            }
-            // Call the procedure
-            return proc->proc(args);
-        }
+void mergeProfile(ProfileTable& into, const ProfileTable& from) {
+    for (auto& kv : from) {
+        ProfileEntry& e = into[kv.first];
+        e.calls += kv.second.calls;
+        e.inclusive += kv.second.inclusive;
+        e.exclusive += kv.second.exclusive;
+        e.allocs += kv.second.allocs;
+        e.selfAllocs += kv.second.selfAllocs;
     }
+}
 
-    // QUOTE
-    if (first->type == Symbol && first->val == "quote") {
-        return expr->list[1]; 
+struct ThreadProfile {
+    ProfileTable table;
+    std::vector<ProfileFrame> stack;
+
+    ~ThreadProfile() {
+        std::lock_guard<std::mutex> lock(profileMutex);
+        mergeProfile(retiredProfile, table);
     }
+};
 
-    // EVAL
-    if (first->type == Symbol && first->val == "eval") {
-        return eval(eval(expr->list[1], env), env); 
+YISP_SHARED thread_local ThreadProfile threadProfile;
+
+// Times one call for as long as it is in scope, also when the call throws
+struct ProfileScope {
+    explicit ProfileScope(const std::string& name) {
+        ProfileEntry& entry = threadProfile.table[name];
+        entry.calls++;
+        entry.active++;
+        threadProfile.stack.push_back({ &entry, ProfileClock::now(), 0, threadHeap.stats.cellsAllocated, 0 });
     }
 
-    // SET
-    if (first->type == Symbol && first->val == "set") {
-        if (expr->list.size() != 3) {
-            throw std::runtime_error("set requires exactly two arguments: a name and a value");
+    ~ProfileScope() {
+        ProfileFrame frame = threadProfile.stack.back();
+        threadProfile.stack.pop_back();
+        double elapsed = std::chrono::duration<double, std::milli>(ProfileClock::now() - frame.start).count();
+        unsigned long allocs = threadHeap.stats.cellsAllocated - frame.startAllocs;
+
+        ProfileEntry& entry = *frame.entry;
+        entry.exclusive += elapsed - frame.childTime;
+        entry.selfAllocs += allocs - frame.childAllocs;
+        if (--entry.active == 0) {
+            entry.inclusive += elapsed;
+            entry.allocs += allocs;
         }
-        std::string var = expr->list[1]->val; 
-        if (expr->list[1]->type != Symbol) {
-            throw std::runtime_error("First argument of set must be a symbol");
+        if (!threadProfile.stack.empty()) {
+            threadProfile.stack.back().childTime += elapsed;
+            threadProfile.stack.back().childAllocs += allocs;
         }
-        CellPtr val = eval(expr->list[2], env); 
-        env->define(var, val);                  
-        return val;
     }
+};
 
-    // IF
-    if (first->type == Symbol && first->val == "if") {
-        if (expr->list.size() < 3) {
-            throw std::runtime_error("if requires at least three arguments");
-        }
-        CellPtr condition = eval(expr->list[1], env); 
-        if (isTrue(condition)) {
-            return eval(expr->list[2], env);          
-        } else if (expr->list.size() > 3) {
-            return eval(expr->list[3], env);         
-        }
-        return std::make_shared<Cell>(Symbol, "nil"); 
+// Prints the table sorted by exclusive time, most expensive first
+void profileReport(std::ostream& out, const ProfileTable& table) {
+    std::vector<std::pair<std::string, ProfileEntry>> rows(table.begin(), table.end());
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second.exclusive > b.second.exclusive;
+    });
+    out << std::left << std::setw(20) << "function" << std::right
+        << std::setw(12) << "calls" << std::setw(14) << "incl ms" << std::setw(14) << "excl ms"
+        << std::setw(12) << "allocs" << std::setw(12) << "self allocs" << '\n';
+    out << std::fixed << std::setprecision(3);
+    for (auto& row : rows) {
+        out << std::left << std::setw(20) << row.first << std::right
+            << std::setw(12) << row.second.calls << std::setw(14) << row.second.inclusive
+            << std::setw(14) << row.second.exclusive << std::setw(12) << row.second.allocs
+            << std::setw(12) << row.second.selfAllocs << '\n';
     }
+    out.unsetf(std::ios::fixed);
+    out << std::setprecision(6);
+}
 
-    // COND
-    if (first->type == Symbol && first->val == "cond") {
-        for (size_t i = 1; i < expr->list.size(); ++i) {
-            CellPtr clause = expr->list[i];
-            if (clause->type != List || clause->list.size() != 2) {
-                throw std::runtime_error("Each cond clause must have exactly two elements");
-            }
-            CellPtr condition = eval(clause->list[0], env); 
-            if (isTrue(condition)) {
-                return eval(clause->list[1], env); 
-            }
+// Calls a primitive, timing it when the profiler is on
+CellPtr applyPrimitive(const std::string& name, CellPtr (*fn)(const Cells&), const Cells& args) {
+    if (profilingEnabled) {
+        ProfileScope scope(name);
+        return fn(args);
+    }
+    return fn(args);
+}
+
+///////////////////////////////////////////////////////////////-EVAL STACK-//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The REPL and batch workers run on a stack of their own, mapped with
+// MAP_NORESERVE so only the pages that deep recursion actually touches use
+// memory; its size (--stack-mb) is the recursion budget. eval and the other
+// recursive walkers check the stack pointer against the limit and raise an
+// error instead of running into the guard page and taking the process down.
+size_t evalStackBytes = 512ul << 20;
+const size_t stackReserve = 256 << 10;  // Left below the limit for primitives, printing and native code
+thread_local char* stackLimit = nullptr;
+
+// Threads not started through runOnEvalStack are limited by their own stack
+char* currentStackLimit() {
+    if (!stackLimit) {
+        pthread_attr_t attr;
+        void* addr = nullptr;
+        size_t size = 0;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+            pthread_attr_getstack(&attr, &addr, &size);
+            pthread_attr_destroy(&attr);
         }
-        return std::make_shared<Cell>(Symbol, "nil"); 
+        stackLimit = static_cast<char*>(addr) + stackReserve;
     }
+    return stackLimit;
+}
 
-    // AND
-    if (first->type == Symbol && first->val == "and") {
-        CellPtr e1 = eval(expr->list[1], env); 
-        if (!isTrue(e1)) return std::make_shared<Cell>(Symbol, "nil"); 
-        return eval(expr->list[2], env); 
+// Bytes left on this thread's stack above the limit
+long stackRemaining() {
+    return static_cast<char*>(__builtin_frame_address(0)) - currentStackLimit();
+}
+
+void checkStack() {
+    if (stackRemaining() < 0) {
+        throw std::runtime_error("Recursion too deep: stack budget of " + std::to_string(evalStackBytes >> 20) + " MB exhausted");
     }
+}
 
-    // OR
-    if (first->type == Symbol && first->val == "or") {
-        CellPtr e1 = eval(expr->list[1], env); 
-        if (isTrue(e1)) return std::make_shared<Cell>(Symbol, "t"); 
-        return eval(expr->list[2], env); 
+struct EvalStackTask {
+    const std::function<void()>* body;
+    std::exception_ptr error;
+};
+
+thread_local EvalStackTask* evalStackTask = nullptr;
+
+void evalStackEntry() {
+    EvalStackTask* task = evalStackTask;
+    try {
+        (*task->body)();
+    } catch (...) {
+        task->error = std::current_exception();
     }
+}
 
-    // Handle built-in list functions
-    if (first->type == Symbol) {
-        std::string funcName = first->val;
+// Runs body on a fresh stack of evalStackBytes; falls back to the current stack if it cannot be mapped
+void runOnEvalStack(const std::function<void()>& body) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = std::max(evalStackBytes, 4 * stackReserve);
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (mem == MAP_FAILED) {
+        body();
+        return;
+    }
+    mprotect(mem, page, PROT_NONE);  // Guard page
 
-        if (funcName == "and?") return procAnd({ eval(expr->list[1], env), eval(expr->list[2], env) });
-        if (funcName == "or?") return procOr({ eval(expr->list[1], env), eval(expr->list[2], env) });
-        if (funcName == "number?") return procNumber({ eval(expr->list[1], env) });
-        if (funcName == "symbol?") return procSymbol({ eval(expr->list[1], env) });
-        if (funcName == "list?") return procList({ eval(expr->list[1], env) });
-        if (funcName == "nil?") return procNil({ eval(expr->list[1], env) });
+    EvalStackTask task{ &body, nullptr };
+    ucontext_t caller, callee;
+    getcontext(&callee);
+    callee.uc_stack.ss_sp = mem;
+    callee.uc_stack.ss_size = size;
+    callee.uc_link = &caller;
+    makecontext(&callee, evalStackEntry, 0);
 
-        if (funcName == "not") return procNot({ eval(expr->list[1], env) });
-        if (funcName == "atom") return procAtom({ eval(expr->list[1], env) });
+    EvalStackTask* outerTask = evalStackTask;
+    char* outerLimit = stackLimit;
+    evalStackTask = &task;
+    stackLimit = static_cast<char*>(mem) + page + stackReserve;
+    swapcontext(&caller, &callee);
+    evalStackTask = outerTask;
+    stackLimit = outerLimit;
+    munmap(mem, size);
+    if (task.error) std::rethrow_exception(task.error);
+}
 
+/////////////////////////////////////////////////////////////////-LIMITS-///////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Per-thread budgets for one evaluation: a number of eval steps, a ceiling on
+// the live heap of this thread, and a wall-clock deadline. eval charges a step
+// on entry while a budget is active; running out throws LimitExceeded, which
+// unwinds the whole evaluation. Budgets nest and an inner one can only be
+// tighter: steps used inside are charged to the enclosing budget as well.
+struct LimitExceeded : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
 
-        // Built-in list manipulation
-        if (funcName == "car") {
-            if (expr->list.size() != 2) {
-                throw std::runtime_error("car requires exactly one argument");
-            }
-            CellPtr arg = eval(expr->list[1], env);
-            if (arg->type != List || arg->list.empty()) {
-                throw std::runtime_error("car requires a non-empty list");
-            }
-            return arg->list[0];
-        }
+using LimitClock = std::chrono::steady_clock;
+
+struct EvalLimits {
+    bool active = false;
+    long steps = LONG_MAX;          // Steps left
+    long memoryCeiling = LONG_MAX;  // Highest threadHeap liveBytes allowed
+    LimitClock::time_point deadline = LimitClock::time_point::max();
+};
+
+thread_local EvalLimits evalLimits;
+
+// Session defaults for every top-level form, 0 for none (--max-steps, --max-memory-mb, --timeout-ms)
+long sessionMaxSteps = 0;
+long sessionMaxMemory = 0;
+long sessionTimeoutMs = 0;
+
+void chargeStep() {
+    EvalLimits& l = evalLimits;
+    if (--l.steps < 0) throw LimitExceeded("Step limit exceeded");
+    if (threadHeap.stats.liveBytes > l.memoryCeiling) throw LimitExceeded("Memory limit exceeded");
+    // Reading the clock costs more than a step, so only look every 1024 steps
+    if ((l.steps & 1023) == 0 && LimitClock::now() > l.deadline) throw LimitExceeded("Time limit exceeded");
+}
+
+// Applies a budget for the lifetime of the scope; 0 leaves that limit as it was
+struct LimitScope {
+    EvalLimits outer;
+    long startSteps;
+
+    LimitScope(long steps, long memoryBytes, long timeMs) : outer(evalLimits) {
+        EvalLimits l = outer;
+        l.active = true;
+        if (steps > 0) l.steps = std::min(l.steps, steps);
+        if (memoryBytes > 0) l.memoryCeiling = std::min(l.memoryCeiling, threadHeap.stats.liveBytes + memoryBytes);
+        if (timeMs > 0) l.deadline = std::min(l.deadline, LimitClock::now() + std::chrono::milliseconds(timeMs));
+        startSteps = l.steps;
+        evalLimits = l;
+    }
+
+    ~LimitScope() {
+        long used = startSteps - evalLimits.steps;
+        long steps = outer.steps == LONG_MAX ? LONG_MAX : outer.steps - used;
+        evalLimits = outer;
+        evalLimits.steps = steps;
+    }
+};
+
+//////////////////////////////////////////////////////////////////-JIT-///////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Baseline x86-64 compiler for small numeric lambdas. Once a Lambda has been
+// called jitThreshold times its body is compiled if it only uses its parameters,
+// integer literals, arithmetic, comparisons, if/cond/and/or/not and calls to
+// itself. Values are kept in rax; operands are spilled to the native stack.
+// Anything the code cannot finish (division by zero, non-number arguments,
+// deep recursion) bails out and the interpreter redoes the call, which is safe
+// because such bodies have no side effects.
+bool jitEnabled = true;
+long jitThreshold = 100;
+const long jitMaxDepth = 10000;
+thread_local long jitSuspended = 0;  // Non-zero while the interpreter redoes a call that bailed out
+
+// Names whose binding a compiled tier resolved ahead: the primitive behind an
+// operator, a form that was not rebound, the function itself for a recursive
+// call. Binding one of them again (bindingChanged) sends the Lambdas that
+// assumed it back to the interpreter.
+struct TierAssumptions {
+    std::mutex mutex;
+    std::unordered_map<std::string, std::vector<std::weak_ptr<Cell>>> users;
+};
+
+TierAssumptions& tierAssumptions() {
+    static TierAssumptions* assumptions = new TierAssumptions;
+    return *assumptions;
+}
+
+void assumeBindings(const CellPtr& user, const std::set<std::string>& names) {
+    TierAssumptions& a = tierAssumptions();
+    std::lock_guard<std::mutex> lock(a.mutex);
+    for (auto& name : names) {
+        auto& users = a.users[name];
+        // Lambdas that died since are dropped before the list has to grow
+        if (users.size() == users.capacity()) {
+            users.erase(std::remove_if(users.begin(), users.end(), [](const std::weak_ptr<Cell>& u) { return u.expired(); }),
+                        users.end());
+        }
+        users.push_back(user);
+    }
+}
+
+CellPtr tierBody(const CellPtr& func);
+
+#if defined(__x86_64__) && defined(__linux__)
+struct JitCompiler {
+    enum Type { Int, Bool };
+
+    const CellPtr& func;
+    EnvironmentPtr env;
+    std::vector<uint8_t> code;
+    std::vector<size_t> bailJumps;  // rel32 fields that jump to the bail-out code
+    std::vector<size_t> exitJumps;  // rel32 fields that jump to the epilogue
+    std::set<std::string> assumed;  // Operators whose binding the code depends on
+
+    JitCompiler(const CellPtr& func) : func(func), env(func->env()) {}
+
+    void emit(std::initializer_list<uint8_t> bytes) { code.insert(code.end(), bytes); }
+
+    void emit32(int32_t v) {
+        for (int i = 0; i < 4; i++) code.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    size_t jump(std::initializer_list<uint8_t> opcode) {
+        emit(opcode);
+        emit32(0);
+        return code.size() - 4;
+    }
+
+    void patch(size_t at, size_t target) {
+        int32_t rel = static_cast<int32_t>(target - (at + 4));
+        std::memcpy(&code[at], &rel, 4);
+    }
+
+    int paramIndex(const std::string& name) {
+        const CellList& params = func->list()[0]->list();
+        for (size_t i = 0; i < params.size(); i++) {
+            if (params[i]->val() == name) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Evaluates a then b, leaving a in rax and b in rcx
+    bool operands(const CellPtr& a, const CellPtr& b) {
+        Type ta, tb;
+        if (!compile(a, ta) || ta != Int) return false;
+        emit({ 0x50 });                    // push rax
+        if (!compile(b, tb) || tb != Int) return false;
+        emit({ 0x48, 0x89, 0xc1 });        // mov rcx, rax
+        emit({ 0x58 });                    // pop rax
+        return true;
+    }
+
+    bool arithmetic(const CellList& l, const std::string& op) {
+        size_t n = l.size() - 1;
+        if (n == 0) {
+            if (op != "add" && op != "mul") return false;
+            emit({ 0x48, 0xc7, 0xc0 });    // mov rax, imm32
+            emit32(op == "add" ? 0 : 1);
+            return true;
+        }
+        Type t;
+        if (!compile(l[1], t) || t != Int) return false;
+        if (n == 1) {
+            if (op == "sub") emit({ 0x48, 0xf7, 0xd8 });  // neg rax
+            return op == "add" || op == "mul" || op == "sub";
+        }
+        for (size_t i = 2; i < l.size(); i++) {
+            emit({ 0x50 });                // push rax
+            if (!compile(l[i], t) || t != Int) return false;
+            emit({ 0x48, 0x89, 0xc1 });    // mov rcx, rax
+            emit({ 0x58 });                // pop rax
+            if (op == "add") emit({ 0x48, 0x01, 0xc8 });              // add rax, rcx
+            else if (op == "sub") emit({ 0x48, 0x29, 0xc8 });         // sub rax, rcx
+            else if (op == "mul") emit({ 0x48, 0x0f, 0xaf, 0xc1 });   // imul rax, rcx
+            else {
+                emit({ 0x48, 0x85, 0xc9 });                           // test rcx, rcx
+                bailJumps.push_back(jump({ 0x0f, 0x84 }));            // jz bail
+                emit({ 0x48, 0x83, 0xf9, 0xff });                     // cmp rcx, -1
+                bailJumps.push_back(jump({ 0x0f, 0x84 }));            // je bail
+                emit({ 0x48, 0x99 });                                 // cqo
+                emit({ 0x48, 0xf7, 0xf9 });                           // idiv rcx
+                if (op == "mod") emit({ 0x48, 0x89, 0xd0 });          // mov rax, rdx
+            }
+        }
+        return true;
+    }
+
+    bool compare(const CellList& l, uint8_t setcc) {
+        if (l.size() != 3 || !operands(l[1], l[2])) return false;
+        emit({ 0x48, 0x39, 0xc8 });        // cmp rax, rcx
+        emit({ 0x0f, setcc, 0xc0 });       // setcc al
+        emit({ 0x0f, 0xb6, 0xc0 });        // movzx eax, al
+        return true;
+    }
+
+    // Leaves the condition in rax and returns the jump taken when it is false,
+    // or SIZE_MAX when the condition is a number and therefore always true
+    bool test(const CellPtr& cond, size_t& falseJump) {
+        Type t;
+        if (!compile(cond, t)) return false;
+        falseJump = SIZE_MAX;
+        if (t == Bool) {
+            emit({ 0x48, 0x85, 0xc0 });    // test rax, rax
+            falseJump = jump({ 0x0f, 0x84 });  // jz
+        }
+        return true;
+    }
+
+    bool branches(const CellPtr& cond, const CellPtr& then, const CellPtr* otherwise, Type& type) {
+        size_t falseJump;
+        if (!test(cond, falseJump)) return false;
+        if (!compile(then, type)) return false;
+        if (falseJump == SIZE_MAX) return true;
+        size_t endJump = jump({ 0xe9 });
+        patch(falseJump, code.size());
+        Type other;
+        if (!otherwise || !compile(*otherwise, other) || other != type) return false;
+        patch(endJump, code.size());
+        return true;
+    }
+
+    bool selfCall(const CellList& l) {
+        size_t n = l.size() - 1;
+        if (n != func->list()[0]->list().size()) return false;
+        // Push the arguments last to first so they form an ascending array at rsp
+        for (size_t i = n; i >= 1; i--) {
+            Type t;
+            if (!compile(l[i], t) || t != Int) return false;
+            emit({ 0x50 });                // push rax
+        }
+        emit({ 0x48, 0x89, 0xe7 });        // mov rdi, rsp
+        emit({ 0x48, 0x89, 0xde });        // mov rsi, rbx
+        size_t call = jump({ 0xe8 });      // call self
+        patch(call, 0);
+        emit({ 0x48, 0x81, 0xc4 });        // add rsp, 8n
+        emit32(static_cast<int32_t>(8 * n));
+        emit({ 0x48, 0x83, 0x3b, 0x00 });  // cmp qword [rbx], 0
+        exitJumps.push_back(jump({ 0x0f, 0x85 }));  // jne epilogue, the callee bailed
+        return true;
+    }
+
+    bool compile(const CellPtr& expr, Type& type) {
+        checkStack();
+        type = Int;
+        if (expr->type == Number) {
+            emit({ 0x48, 0xb8 });          // mov rax, imm64
+            long v = numberValue(expr);
+            for (int i = 0; i < 8; i++) code.push_back(static_cast<uint8_t>(static_cast<unsigned long>(v) >> (8 * i)));
+            return true;
+        }
+        if (expr->type == Symbol) {
+            int idx = paramIndex(expr->val());
+            if (idx >= 0) {
+                emit({ 0x49, 0x8b, 0x84, 0x24 });  // mov rax, [r12 + 8*idx]
+                emit32(8 * idx);
+                return true;
+            }
+            type = Bool;
+            if (expr->val() == "t") { emit({ 0xb8, 0x01, 0x00, 0x00, 0x00 }); return true; }   // mov eax, 1
+            if (expr->val() == "nil") { emit({ 0x31, 0xc0 }); return true; }                   // xor eax, eax
+            return false;
+        }
+        if (expr->type != List || expr->list().empty() || expr->list()[0]->type != Symbol) return false;
+
+        const CellList& l = expr->list();
+        const std::string& op = l[0]->val();
+        if (paramIndex(op) >= 0) return false;
+        assumed.insert(op);
+
+        Primitive prim = numericPrimitive(op, env, l.size() - 1);
+        if (prim == procAdd) return arithmetic(l, "add");
+        if (prim == procSub) return arithmetic(l, "sub");
+        if (prim == procMul) return arithmetic(l, "mul");
+        if (prim == procDiv) return l.size() >= 3 && arithmetic(l, "div");
+        if (prim == procMod) return l.size() == 3 && arithmetic(l, "mod");
+
+        type = Bool;
+        if (prim == procGreaterThan) return compare(l, 0x9f);    // setg
+        if (prim == procLessThan) return compare(l, 0x9c);       // setl
+        if (prim == procEquals) return compare(l, 0x94);         // sete
+        if (prim == procGreaterEqual) return compare(l, 0x9d);   // setge
+        if (prim == procLessEqual) return compare(l, 0x9e);      // setle
+        if (prim == procNot) {
+            Type t;
+            if (l.size() != 2 || !compile(l[1], t)) return false;
+            if (t == Int) emit({ 0x31, 0xc0 });          // xor eax, eax: numbers are true
+            else emit({ 0x83, 0xf0, 0x01 });             // xor eax, 1
+            return true;
+        }
+
+        CellPtr bound = env->lookup(op);
+        if (bound && bound->type == Proc) return false;
+        if (op == "if") {
+            if (l.size() < 3) return false;
+            return branches(l[1], l[2], l.size() > 3 ? &l[3] : nullptr, type);
+        }
+        if (op == "cond") {
+            // The last clause has to be taken unconditionally, falling off the end returns nil
+            std::vector<size_t> endJumps;
+            bool first = true;
+            for (size_t i = 1; i < l.size(); i++) {
+                const CellPtr& clause = l[i];
+                if (clause->type != List || clause->list().size() != 2) return false;
+                bool last = i + 1 == l.size();
+                size_t falseJump;
+                if (last && clause->list()[0]->type == Symbol && clause->list()[0]->val() == "t") {
+                    falseJump = SIZE_MAX;
+                } else if (!test(clause->list()[0], falseJump)) {
+                    return false;
+                }
+                if (last && falseJump != SIZE_MAX) return false;
+                Type t;
+                if (!compile(clause->list()[1], t) || (!first && t != type)) return false;
+                type = t;
+                first = false;
+                if (falseJump == SIZE_MAX) break;
+                endJumps.push_back(jump({ 0xe9 }));
+                patch(falseJump, code.size());
+            }
+            if (first) return false;
+            for (size_t j : endJumps) patch(j, code.size());
+            return true;
+        }
+        if (op == "and" || op == "or") {
+            if (l.size() != 3) return false;
+            Type t;
+            size_t falseJump;
+            if (!test(l[1], falseJump)) return false;
+            if (op == "and") {
+                if (!compile(l[2], t) || t != Bool) return false;
+                if (falseJump != SIZE_MAX) {
+                    size_t endJump = jump({ 0xe9 });
+                    patch(falseJump, code.size());
+                    emit({ 0x31, 0xc0 });  // xor eax, eax
+                    patch(endJump, code.size());
+                }
+                return true;
+            }
+            if (falseJump == SIZE_MAX) {
+                emit({ 0xb8, 0x01, 0x00, 0x00, 0x00 });  // mov eax, 1
+                return true;
+            }
+            size_t trueJump = jump({ 0xe9 });
+            patch(falseJump, code.size());
+            if (!compile(l[2], t) || t != Bool) return false;
+            size_t endJump = jump({ 0xe9 });
+            patch(trueJump, code.size());
+            emit({ 0xb8, 0x01, 0x00, 0x00, 0x00 });  // mov eax, 1
+            patch(endJump, code.size());
+            return true;
+        }
+
+        type = Int;
+        if (op == func->val()) return selfCall(l);
+        return false;
+    }
+
+    JitFunction build() {
+        const CellList& params = func->list()[0]->list();
+        if (params.size() > tierMaxParams) return nullptr;
+        for (auto& p : params) {
+            if (p->type != Symbol) return nullptr;
+        }
+
+        emit({ 0x53 });                    // push rbx
+        emit({ 0x41, 0x54 });              // push r12
+        emit({ 0x55 });                    // push rbp
+        emit({ 0x48, 0x89, 0xe5 });        // mov rbp, rsp: a bail-out leaves operands pushed
+        emit({ 0x48, 0x89, 0xf3 });        // mov rbx, rsi
+        emit({ 0x49, 0x89, 0xfc });        // mov r12, rdi
+        emit({ 0x48, 0xff, 0x4b, 0x08 });  // dec qword [rbx+8]
+        bailJumps.push_back(jump({ 0x0f, 0x84 }));  // jz bail: too deep
+
+        Type type;
+        if (!compile(tierBody(func), type) || type != Int) return nullptr;
+
+        size_t epilogue = code.size();
+        emit({ 0x48, 0xff, 0x43, 0x08 });  // inc qword [rbx+8]
+        emit({ 0x48, 0x89, 0xec });        // mov rsp, rbp
+        emit({ 0x5d });                    // pop rbp
+        emit({ 0x41, 0x5c });              // pop r12
+        emit({ 0x5b });                    // pop rbx
+        emit({ 0xc3 });                    // ret
+        size_t bail = code.size();
+        emit({ 0x48, 0xc7, 0x03 });        // mov qword [rbx], 1
+        emit32(1);
+        exitJumps.push_back(jump({ 0xe9 }));  // jmp epilogue
+
+        for (size_t j : bailJumps) patch(j, bail);
+        for (size_t j : exitJumps) patch(j, epilogue);
+
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t size = (code.size() + page - 1) / page * page;
+        void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) return nullptr;
+        std::memcpy(mem, code.data(), code.size());
+        if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(mem, size);
+            return nullptr;
+        }
+        func->lambda()->jitSize = size;
+        return reinterpret_cast<JitFunction>(mem);
+    }
+};
+
+// Compiles a hot Lambda; only one thread compiles, the others keep interpreting meanwhile
+void jitCompile(const CellPtr& func) {
+    LambdaData& data = *func->lambda();
+    int idle = TierIdle;
+    if (!data.jitState.compare_exchange_strong(idle, TierCompiling)) return;
+    JitFunction code = nullptr;
+    try {
+        JitCompiler compiler(func);
+        code = compiler.build();
+        if (code) assumeBindings(func, compiler.assumed);
+    } catch (const std::exception&) {
+        // A literal that does not fit a long or a macro call that does not expand;
+        // leave the body to the interpreter
+    }
+    data.jitCode = code;
+    data.jitState.store(code ? TierReady : TierRejected, std::memory_order_release);
+}
+
+// Runs compiled code; false when the arguments are not all numbers or the code bailed out
+bool jitCall(const CellPtr& func, const Cells& args, CellPtr& result) {
+    long values[tierMaxParams];
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i]->type != Number) return false;
+        values[i] = numberValue(args[i]);
+    }
+    // Native frames are small, but the depth must still fit the stack that is left
+    JitContext ctx = { 0, std::min(jitMaxDepth, stackRemaining() / 1024) };
+    if (ctx.depth <= 0) return false;
+    long r = func->lambda()->jitCode(values, &ctx);
+    if (ctx.bail) return false;
+    result = makeNumber(r);
+    return true;
+}
+#else
+void jitCompile(const CellPtr& func) {
+    func->lambda()->jitState.store(TierRejected, std::memory_order_relaxed);
+}
+
+bool jitCall(const CellPtr&, const Cells&, CellPtr&) {
+    return false;
+}
+#endif
+
+///////////////////////////////////////////////////////////////-GREEN THREADS-///////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Coroutines scheduled cooperatively on the OS thread that started them. `go`
+// runs an expression as a task on a stack of its own; a task keeps running
+// until it yields, blocks on a channel or finishes. The thread's own context
+// takes part in the schedule like a task, so the REPL can block in recv too,
+// and after every top-level form it lets the ready tasks run until they are
+// all finished or blocked. Task stacks are mapped MAP_NORESERVE and reused,
+// so a task costs its context plus the pages it actually touches.
+size_t taskStackBytes = 8ul << 20;
+const size_t taskStackReserve = 64 << 10;
+const size_t cachedTaskStacks = 64;
+
+CellPtr eval(CellPtr expr, EnvironmentPtr env);
+
+struct GreenTask {
+    ucontext_t context;
+    char* stack = nullptr;
+    CellPtr expr;
+    EnvironmentPtr env;
+    long id = 0;
+    bool deadlocked = false;  // Woken because nothing else can run any more
+
+    // The thread-local evaluation state of this context while it is switched out
+    char* stackLimit = nullptr;
+    EvalLimits limits;
+    long jitSuspended = 0;
+};
+
+struct Channel {
+    size_t capacity;
+    std::deque<CellPtr> items;
+    std::deque<GreenTask*> receivers;  // Parked until an item arrives
+    std::deque<GreenTask*> senders;    // Parked until there is room
+    std::thread::id owner = std::this_thread::get_id();
+};
+
+struct Scheduler {
+    GreenTask root;  // The thread's own context
+    GreenTask* current = &root;
+    std::deque<GreenTask*> ready;
+    std::set<GreenTask*> tasks;     // Every task not yet finished, parked ones included
+    std::vector<GreenTask*> dead;   // Finished, freed once execution is off their stack
+    std::vector<char*> freeStacks;
+    long nextId = 0;
+
+    ~Scheduler() {
+        reap();
+        for (GreenTask* t : tasks) release(t);
+        for (char* stack : freeStacks) munmap(stack, taskStackBytes);
+    }
+
+    char* takeStack() {
+        if (!freeStacks.empty()) {
+            char* stack = freeStacks.back();
+            freeStacks.pop_back();
+            return stack;
+        }
+        void* mem = mmap(nullptr, taskStackBytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if (mem == MAP_FAILED) throw std::runtime_error("go: cannot map a task stack");
+        mprotect(mem, static_cast<size_t>(sysconf(_SC_PAGESIZE)), PROT_NONE);  // Guard page
+        return static_cast<char*>(mem);
+    }
+
+    void release(GreenTask* t) {
+        if (freeStacks.size() < cachedTaskStacks) {
+            freeStacks.push_back(t->stack);
+        } else {
+            munmap(t->stack, taskStackBytes);
+        }
+        delete t;
+    }
+
+    void reap() {
+        for (GreenTask* t : dead) release(t);
+        dead.clear();
+    }
+
+    void switchTo(GreenTask* next) {
+        GreenTask* prev = current;
+        prev->stackLimit = stackLimit;
+        prev->limits = evalLimits;
+        prev->jitSuspended = jitSuspended;
+        current = next;
+        stackLimit = next->stackLimit;
+        evalLimits = next->limits;
+        jitSuspended = next->jitSuspended;
+        swapcontext(&prev->context, &next->context);
+        reap();
+    }
+
+    // Gives up the processor until something wakes the current context again.
+    // When nothing else is ready every task is blocked, so the root is told it
+    // is deadlocked; the root itself just returns with the flag set.
+    void park() {
+        if (!ready.empty()) {
+            GreenTask* next = ready.front();
+            ready.pop_front();
+            switchTo(next);
+            return;
+        }
+        root.deadlocked = true;
+        if (current != &root) switchTo(&root);
+    }
+
+    void wake(std::deque<GreenTask*>& waiters) {
+        if (waiters.empty()) return;
+        ready.push_back(waiters.front());
+        waiters.pop_front();
+    }
+
+    void yield() {
+        if (ready.empty()) return;
+        ready.push_back(current);
+        GreenTask* next = ready.front();
+        ready.pop_front();
+        switchTo(next);
+    }
+};
+
+thread_local Scheduler scheduler;
+
+void taskEntry() {
+    Scheduler& s = scheduler;
+    GreenTask* self = s.current;
+    try {
+        eval(self->expr, self->env);
+    } catch (const std::exception& e) {
+        std::cout.flush();
+        std::cerr << "Error in task " << self->id << ": " << e.what() << std::endl;
+    }
+    self->expr.reset();
+    self->env.reset();
+    s.tasks.erase(self);
+    s.dead.push_back(self);
+
+    // Never returns: the next context frees this task's stack
+    GreenTask* next = &s.root;
+    if (!s.ready.empty()) {
+        next = s.ready.front();
+        s.ready.pop_front();
+    } else {
+        s.root.deadlocked = true;
+    }
+    s.switchTo(next);
+}
+
+CellPtr spawnTask(const CellPtr& expr, const EnvironmentPtr& env) {
+    Scheduler& s = scheduler;
+    std::unique_ptr<GreenTask> t(new GreenTask());
+    t->stack = s.takeStack();
+    t->expr = expr;
+    t->env = env;
+    t->id = ++s.nextId;
+    getcontext(&t->context);
+    t->context.uc_stack.ss_sp = t->stack;
+    t->context.uc_stack.ss_size = taskStackBytes;
+    t->context.uc_link = nullptr;
+    makecontext(&t->context, taskEntry, 0);
+    t->stackLimit = t->stack + sysconf(_SC_PAGESIZE) + taskStackReserve;
+    t->limits = evalLimits;
+    s.tasks.insert(t.get());
+    s.ready.push_back(t.get());
+    return makeNumber(t.release()->id);
+}
+
+// Lets every ready task run until all of them have finished or are blocked
+void runGreenThreads() {
+    Scheduler& s = scheduler;
+    while (!s.ready.empty()) s.yield();
+}
+
+Channel& channelArgument(const Cells& args, const char* name, size_t count) {
+    if (args.size() != count || args[0]->type != Chan) {
+        throw std::runtime_error(std::string(name) + " requires a channel" + (count > 1 ? " and a value" : ""));
+    }
+    Channel& ch = *args[0]->channel();
+    if (ch.owner != std::this_thread::get_id()) {
+        throw std::runtime_error(std::string(name) + ": channel belongs to another thread");
+    }
+    return ch;
+}
+
+// Parks the current context on `waiters`; throws if that can never end
+void blockOn(std::deque<GreenTask*>& waiters, const char* what) {
+    Scheduler& s = scheduler;
+    waiters.push_back(s.current);
+    s.park();
+    if (s.current == &s.root && s.root.deadlocked) {
+        s.root.deadlocked = false;
+        waiters.erase(std::remove(waiters.begin(), waiters.end(), &s.root), waiters.end());
+        throw std::runtime_error(std::string("Deadlock: ") + what + " and no task can run");
+    }
+}
+
+CellPtr procChan(const Cells& args) {
+    long capacity = 1;
+    if (args.size() > 1 || (args.size() == 1 && (args[0]->type != Number || numberValue(args[0]) < 1))) {
+        throw std::runtime_error("chan takes an optional positive capacity");
+    }
+    if (args.size() == 1) capacity = numberValue(args[0]);
+    static std::atomic<long> channels(0);
+    auto cell = std::make_shared<Cell>(Chan, "<Channel " + std::to_string(++channels) + ">");
+    cell->mutableChannel() = std::make_shared<Channel>();
+    cell->channel()->capacity = static_cast<size_t>(capacity);
+    return cell;
+}
+
+CellPtr procSend(const Cells& args) {
+    Channel& ch = channelArgument(args, "send", 2);
+    while (ch.items.size() >= ch.capacity) blockOn(ch.senders, "send on a full channel");
+    ch.items.push_back(args[1]);
+    scheduler.wake(ch.receivers);
+    return args[1];
+}
+
+CellPtr procRecv(const Cells& args) {
+    Channel& ch = channelArgument(args, "recv", 1);
+    while (ch.items.empty()) blockOn(ch.receivers, "recv on an empty channel");
+    CellPtr value = ch.items.front();
+    ch.items.pop_front();
+    scheduler.wake(ch.senders);
+    return value;
+}
+
+CellPtr procYield(const Cells& args) {
+    if (!args.empty()) throw std::runtime_error("yield takes no arguments");
+    scheduler.yield();
+    return std::make_shared<Cell>(Symbol, "t");
+}
+
+////////////////////////////////////////////////////////////////-STREAMS-///////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// (delay expr) makes a Promise Cell holding expr and the Environment it was
+// written in. (force p) evaluates it the first time and keeps the value in
+// place of the expression, letting go of the Environment. A stream is nil or a
+// list of a value and a promise of the rest of the stream; (stream-cons a b)
+// delays b. stream-map and stream-filter give streams whose tails are native
+// promises over their source, and stream-take and stream-ref walk a stream in
+// a loop, so a pipeline holds only the elements it is working on however long
+// or infinite its source is.
+
+// Guards the state of promises shared by batch threads; never held while one runs
+std::mutex promiseMutex;
+
+CellPtr applyProcedure(const CellPtr& func, const Cells& args);
+
+CellPtr makePromise(const CellPtr& expr, const EnvironmentPtr& env) {
+    auto cell = std::make_shared<Cell>(Promise, "<Promise>");
+    cell->mutableList().push_back(expr);
+    cell->mutableEnv() = env;
+    return cell;
+}
+
+// A promise of what native code computes, for the streams built below
+CellPtr makePromise(std::function<CellPtr(const Cells&)> thunk) {
+    auto cell = std::make_shared<Cell>(Promise, "<Promise>");
+    cell->mutableProc() = std::move(thunk);
+    return cell;
+}
+
+// Anything other than a promise is its own value
+CellPtr force(const CellPtr& value) {
+    if (value->type != Promise) return value;
+    CellPtr expr;
+    EnvironmentPtr env;
+    std::function<CellPtr(const Cells&)> thunk;
+    {
+        std::lock_guard<std::mutex> lock(promiseMutex);
+        if (!value->env() && !value->proc()) return value->list()[0];
+        if (value->proc()) thunk = value->proc();
+        else {
+            expr = value->list()[0];
+            env = value->env();
+        }
+    }
+    CellPtr result = thunk ? thunk({}) : eval(expr, env);
+    std::lock_guard<std::mutex> lock(promiseMutex);
+    // Forced again while it ran; the first value stays
+    if (value->env() || value->proc()) {
+        value->mutableList().assign(1, result);
+        value->mutableEnv() = nullptr;
+        value->mutableProc() = nullptr;
+    }
+    return value->list()[0];
+}
+
+bool streamEmpty(const CellPtr& s) {
+    return (s->type == Symbol && s->val() == "nil") || (s->type == List && s->list().empty());
+}
+
+const CellPtr& streamPair(const CellPtr& s, const char* what) {
+    if (s->type != List || s->list().size() != 2) {
+        throw std::runtime_error(std::string(what) + " requires a non-empty stream");
+    }
+    return s;
+}
+
+CellPtr streamMap(const CellPtr& func, const CellPtr& s) {
+    if (streamEmpty(s)) return std::make_shared<Cell>(Symbol, "nil");
+    streamPair(s, "stream-map");
+    auto result = std::make_shared<Cell>(List);
+    result->mutableList().push_back(applyProcedure(func, { s->list()[0] }));
+    result->mutableList().push_back(makePromise([func, s](const Cells&) { return streamMap(func, force(s->list()[1])); }));
+    return result;
+}
+
+// Skips to the first element the predicate holds for, one tail at a time
+CellPtr streamFilter(const CellPtr& pred, CellPtr s) {
+    while (!streamEmpty(s)) {
+        streamPair(s, "stream-filter");
+        if (isTrue(applyProcedure(pred, { s->list()[0] }))) {
+            auto result = std::make_shared<Cell>(List);
+            result->mutableList().push_back(s->list()[0]);
+            result->mutableList().push_back(makePromise([pred, s](const Cells&) { return streamFilter(pred, force(s->list()[1])); }));
+            return result;
+        }
+        s = force(s->list()[1]);
+    }
+    return std::make_shared<Cell>(Symbol, "nil");
+}
+
+CellPtr procForce(const Cells& args) {
+    if (args.size() != 1) throw std::runtime_error("force requires exactly one argument");
+    return force(args[0]);
+}
+
+CellPtr procStreamCar(const Cells& args) {
+    if (args.size() != 1) throw std::runtime_error("stream-car requires exactly one argument");
+    return streamPair(args[0], "stream-car")->list()[0];
+}
+
+CellPtr procStreamCdr(const Cells& args) {
+    if (args.size() != 1) throw std::runtime_error("stream-cdr requires exactly one argument");
+    return force(streamPair(args[0], "stream-cdr")->list()[1]);
+}
+
+// stream-take and stream-ref are special forms, so the stream they walk is only
+// held here: the elements already passed are freed as the walk goes on.
+
+// A list of the first n elements; the tail after the last one is not forced
+CellPtr streamTake(CellPtr s, long n) {
+    auto result = std::make_shared<Cell>(List);
+    for (long i = 0; i < n && !streamEmpty(s); i++) {
+        result->mutableList().push_back(streamPair(s, "stream-take")->list()[0]);
+        if (i + 1 < n) s = force(s->list()[1]);
+    }
+    return result;
+}
+
+CellPtr streamRef(CellPtr s, long n) {
+    for (long i = 0; i < n && !streamEmpty(s); i++) s = force(streamPair(s, "stream-ref")->list()[1]);
+    if (streamEmpty(s)) throw std::runtime_error("stream-ref: the stream has no element " + std::to_string(n));
+    return streamPair(s, "stream-ref")->list()[0];
+}
+
+CellPtr procStreamMap(const Cells& args) {
+    if (args.size() != 2) throw std::runtime_error("stream-map requires a function and a stream");
+    return streamMap(args[0], args[1]);
+}
+
+CellPtr procStreamFilter(const Cells& args) {
+    if (args.size() != 2) throw std::runtime_error("stream-filter requires a predicate and a stream");
+    return streamFilter(args[0], args[1]);
+}
+
+///////////////////////////////////////////////////////////////-PIPELINES-///////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// (map f xs), (filter p xs), (reduce f init xs) and (for-each f xs) walk the
+// elements of a List in C++ and call f through applyProcedure, so a Lambda
+// goes straight to its tiers. When the list argument of one of them is itself
+// a call to the builtin map or filter, eval runs the whole chain as a pipeline:
+// each element passes through every stage before the next one is looked at,
+// and no list is built between stages. The functions of a chain are evaluated
+// outermost first, then the source list; calls to them interleave element by
+// element instead of running stage by stage.
+struct PipelineStage {
+    bool filter;   // Keeps elements func holds for, instead of replacing them
+    CellPtr func;
+};
+
+// Passes each element of xs through the stages and hands the ones that come out to emit
+template <typename Emit>
+void runPipeline(const std::vector<PipelineStage>& stages, const CellPtr& xs, const std::string& what, Emit emit) {
+    if (xs->type == Symbol && xs->val() == "nil") return;
+    if (xs->type != List) throw std::runtime_error(what + " requires a list");
+    Cells arg(1);
+    for (auto& e : xs->list()) {
+        CellPtr value = e;
+        bool kept = true;
+        for (auto& stage : stages) {
+            arg[0] = value;
+            CellPtr result = applyProcedure(stage.func, arg);
+            if (!stage.filter) value = std::move(result);
+            else if (!isTrue(result)) {
+                kept = false;
+                break;
+            }
+        }
+        if (kept) emit(value);
+    }
+}
+
+// Runs the stages and finishes with the sequence primitive `sink`; `what` names
+// the call that takes xs, for errors
+CellPtr finishPipeline(Primitive sink, const CellPtr& func, CellPtr init, const std::vector<PipelineStage>& stages,
+                       const CellPtr& xs, const std::string& what) {
+    if (sink == procReduce) {
+        Cells pair(2);
+        runPipeline(stages, xs, what, [&](const CellPtr& value) {
+            pair[0] = init;
+            pair[1] = value;
+            init = applyProcedure(func, pair);
+        });
+        return init;
+    }
+    if (sink == procForEach) {
+        Cells arg(1);
+        runPipeline(stages, xs, what, [&](const CellPtr& value) {
+            arg[0] = value;
+            applyProcedure(func, arg);
+        });
+        return std::make_shared<Cell>(Symbol, "nil");
+    }
+    auto result = std::make_shared<Cell>(List);
+    if (xs->type == List) result->mutableList().reserve(xs->list().size());
+    runPipeline(stages, xs, what, [&](const CellPtr& value) {
+        result->mutableList().push_back(value);
+    });
+    return result;
+}
+
+Primitive sequencePrimitive(const CellPtr& bound) {
+    if (!bound || bound->type != Proc) return nullptr;
+    const Primitive* target = bound->proc().target<Primitive>();
+    if (!target) return nullptr;
+    if (*target == procMap || *target == procFilter || *target == procReduce || *target == procForEach) return *target;
+    return nullptr;
+}
+
+// The builtin map or filter called with its two arguments by expr, or nullptr
+Primitive pipelineStage(const CellPtr& expr, const EnvironmentPtr& env) {
+    if (expr->type != List || expr->list().size() != 3 || expr->list()[0]->type != Symbol) return nullptr;
+    const std::string& name = expr->list()[0]->val();
+    if (name != "map" && name != "filter") return nullptr;
+    Primitive stage = sequencePrimitive(env->lookup(name));
+    return stage == procMap || stage == procFilter ? stage : nullptr;
+}
+
+// True when expr, which calls the Proc `bound`, can run as one fused pipeline
+bool isPipeline(const CellPtr& expr, const CellPtr& bound, const EnvironmentPtr& env) {
+    size_t argc = expr->list().size() - 1;
+    if (argc != 2 && argc != 3) return false;
+    if (!pipelineStage(expr->list().back(), env)) return false;
+    Primitive sink = sequencePrimitive(bound);
+    return sink && argc == (sink == procReduce ? 3u : 2u);
+}
+
+CellPtr evalPipeline(const CellPtr& expr, const CellPtr& bound, const EnvironmentPtr& env) {
+    Primitive sink = sequencePrimitive(bound);
+    CellPtr func = eval(expr->list()[1], env);
+    CellPtr init = sink == procReduce ? eval(expr->list()[2], env) : nullptr;
+    // Stages are found outermost first, as they are evaluated, and run innermost first
+    std::vector<PipelineStage> stages;
+    if (sink == procMap || sink == procFilter) {
+        stages.push_back({ sink == procFilter, func });
+    }
+    CellPtr source = expr->list().back();
+    std::string what = expr->list()[0]->val();
+    while (Primitive stage = pipelineStage(source, env)) {
+        stages.push_back({ stage == procFilter, eval(source->list()[1], env) });
+        what = source->list()[0]->val();
+        source = source->list()[2];
+    }
+    std::reverse(stages.begin(), stages.end());
+    return finishPipeline(sink, func, init, stages, eval(source, env), what);
+}
+
+CellPtr procMap(const Cells& args) {
+    if (args.size() != 2) throw std::runtime_error("map requires a function and a list");
+    return finishPipeline(procMap, nullptr, nullptr, { { false, args[0] } }, args[1], "map");
+}
+
+CellPtr procFilter(const Cells& args) {
+    if (args.size() != 2) throw std::runtime_error("filter requires a predicate and a list");
+    return finishPipeline(procFilter, nullptr, nullptr, { { true, args[0] } }, args[1], "filter");
+}
+
+CellPtr procReduce(const Cells& args) {
+    if (args.size() != 3) throw std::runtime_error("reduce requires a function, an initial value and a list");
+    return finishPipeline(procReduce, args[0], args[1], {}, args[2], "reduce");
+}
+
+CellPtr procForEach(const Cells& args) {
+    if (args.size() != 2) throw std::runtime_error("for-each requires a function and a list");
+    return finishPipeline(procForEach, args[0], nullptr, {}, args[1], "for-each");
+}
+
+///////////////////////////////////////////////////////////////-BINARY ENCODING-/////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Number, Symbol, String and List Cells as bytes. Each Cell is a tag followed by
+// a zigzag varint for a number that round-trips through a long, a varint length
+// and the characters for a symbol, a string or any other number, or a varint
+// count and the elements for a list. Given an atom table, each distinct symbol,
+// string and number is written once elsewhere and referred to by its index.
+// Functions, channels, stores and promises have no encoding.
+enum EncodingTag : unsigned char { TagInt = 1, TagNumber, TagSymbol, TagList, TagAtomRef, TagString };
+
+// Atoms met while encoding, keyed by CellType and text, and the order they were met in
+struct AtomTable {
+    std::unordered_map<std::string, size_t> indexes;
+    Cells atoms;
+};
+
+void putVarint(std::string& out, unsigned long v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+unsigned long getVarint(const char*& p, const char* end) {
+    unsigned long v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) break;
+        unsigned char b = static_cast<unsigned char>(*p++);
+        v |= static_cast<unsigned long>(b & 0x7f) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    throw std::runtime_error("Corrupt encoded data: bad length");
+}
+
+void encodeCell(const CellPtr& cell, std::string& out, AtomTable* table = nullptr) {
+    checkStack();
+    if (table && (cell->type == Number || cell->type == Symbol || cell->type == String)) {
+        std::string key = static_cast<char>(cell->type) + (cell->type == String ? stringText(cell)
+                                                          : cell->type == Number ? std::to_string(cell->number) : cell->val());
+        auto added = table->indexes.emplace(std::move(key), table->atoms.size());
+        if (added.second) table->atoms.push_back(cell);
+        out += static_cast<char>(TagAtomRef);
+        putVarint(out, added.first->second);
+        return;
+    }
+    switch (cell->type) {
+    case Number: {
+        unsigned long n = static_cast<unsigned long>(cell->number);
+        out += static_cast<char>(TagInt);
+        putVarint(out, (n << 1) ^ static_cast<unsigned long>(cell->number >> 63));
+        return;
+    }
+    case Symbol:
+        out += static_cast<char>(TagSymbol);
+        putVarint(out, cell->val().size());
+        out += cell->val();
+        return;
+    case String:
+        out += static_cast<char>(TagString);
+        putVarint(out, stringLength(cell.get()));
+        appendText(cell.get(), 0, stringLength(cell.get()), out);
+        return;
+    case List:
+        out += static_cast<char>(TagList);
+        putVarint(out, cell->list().size());
+        for (auto& e : cell->list()) encodeCell(e, out, table);
+        return;
+    default:
+        throw std::runtime_error(std::string("Cannot encode a ") + cellTypeName(cell->type));
+    }
+}
+
+CellPtr decodeAtom(unsigned char tag, const char*& p, const char* end, const Cells* atoms) {
+    if (tag == TagAtomRef) {
+        unsigned long index = getVarint(p, end);
+        if (!atoms || index >= atoms->size()) throw std::runtime_error("Corrupt encoded data: bad atom");
+        return (*atoms)[index];
+    }
+    if (tag == TagInt) {
+        unsigned long z = getVarint(p, end);
+        return makeNumber(static_cast<long>(z >> 1) ^ -static_cast<long>(z & 1));
+    }
+    if (tag == TagNumber || tag == TagSymbol || tag == TagString) {
+        unsigned long size = getVarint(p, end);
+        if (size > static_cast<unsigned long>(end - p)) throw std::runtime_error("Corrupt encoded data: truncated");
+        CellType type = tag == TagNumber ? Number : tag == TagSymbol ? Symbol : String;  // Numbers as text: older files only
+        auto cell = std::make_shared<Cell>(type, std::string(p, size));
+        p += size;
+        return cell;
+    }
+    throw std::runtime_error("Corrupt encoded data: unknown tag");
+}
+
+// Fills lists from an explicit stack, so deeply nested data decodes without recursion
+CellPtr decodeCell(const char*& p, const char* end, const Cells* atoms = nullptr) {
+    struct Open {
+        Cell* list;
+        unsigned long left;  // Elements still to come
+    };
+    std::vector<Open> open;
+    CellPtr root;
+    do {
+        if (p == end) throw std::runtime_error("Corrupt encoded data: truncated");
+        unsigned char tag = static_cast<unsigned char>(*p++);
+        CellPtr value;
+        Open list{ nullptr, 0 };
+        if (tag == TagList) {
+            list.left = getVarint(p, end);
+            // Every element takes at least one byte
+            if (list.left > static_cast<unsigned long>(end - p)) throw std::runtime_error("Corrupt encoded data: truncated");
+            value = std::make_shared<Cell>(List);
+            value->mutableList().reserve(list.left);
+            list.list = value.get();
+        } else {
+            value = decodeAtom(tag, p, end, atoms);
+        }
+
+        if (open.empty()) root = value;
+        else {
+            open.back().list->mutableList().push_back(std::move(value));
+            open.back().left--;
+        }
+        if (list.left) open.push_back(list);
+        while (!open.empty() && !open.back().left) open.pop_back();
+    } while (!open.empty());
+    return root;
+}
+
+//////////////////////////////////////////////////////////////////-STORE-////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// (store-open "file"), a special form like load-native, maps a file that holds a log of records: store-put appends
+// the encoded key and value, store-del appends a tombstone for the key. Opening
+// scans the log once into an index from encoded key to where the value lies in
+// the mapping, so store-get is a hash lookup and a decode without a system call.
+// A record's header is written after its data and carries a checksum; a record
+// cut short by a crash fails the check and the log ends before it on the next
+// open. When dead records take up more than the live ones, the log is rewritten
+// into a temporary file that is renamed over the old one.
+const char storeMagic[8] = { 'Y', 'I', 'S', 'P', 'K', 'V', '0', '1' };
+const size_t storeHeaderBytes = 16;
+const uint32_t recordMagic = 0x59524543;   // "YREC"
+const uint32_t tombstone = UINT32_MAX;     // valueBytes of a del record
+const size_t storeInitialBytes = 64 << 10;
+const size_t storeCompactMinimum = 1 << 20;
+
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t keyBytes;
+    uint32_t valueBytes;
+    uint32_t checksum;
+};
+
+uint32_t recordChecksum(const char* key, uint32_t keyBytes, const char* value, uint32_t valueBytes) {
+    uint32_t h = 2166136261u;
+    auto mix = [&](const char* p, size_t n) {
+        for (size_t i = 0; i < n; i++) h = (h ^ static_cast<unsigned char>(p[i])) * 16777619u;
+    };
+    mix(reinterpret_cast<const char*>(&keyBytes), sizeof keyBytes);
+    mix(reinterpret_cast<const char*>(&valueBytes), sizeof valueBytes);
+    mix(key, keyBytes);
+    if (valueBytes != tombstone) mix(value, valueBytes);
+    return h;
+}
+
+struct KeyValueStore {
+    std::string path;
+    int fd = -1;
+    char* base = nullptr;
+    size_t capacity = 0;    // Bytes of the file that are mapped
+    size_t end = 0;         // Where the next record goes
+    size_t deadBytes = 0;   // Records overwritten or deleted since
+    std::unordered_map<std::string, std::pair<size_t, size_t>> index;  // Encoded key to value offset and size
+    std::mutex mutex;
+
+    ~KeyValueStore() {
+        if (base) {
+            msync(base, end, MS_SYNC);
+            munmap(base, capacity);
+        }
+        if (fd >= 0) {
+            if (ftruncate(fd, static_cast<off_t>(end)) != 0) {
+                // The tail is zeros and is skipped by the next open anyway
+            }
+            close(fd);
+        }
+    }
+
+    [[noreturn]] void fail(const std::string& what) {
+        throw std::runtime_error("Store " + path + ": " + what + " (" + std::strerror(errno) + ")");
+    }
+
+    void map(size_t bytes) {
+        if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) fail("cannot grow file");
+        void* p = base ? mremap(base, capacity, bytes, MREMAP_MAYMOVE)
+                       : mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) fail("cannot map file");
+        base = static_cast<char*>(p);
+        capacity = bytes;
+    }
+
+    void open() {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) fail("cannot open");
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) fail("in use by another process");
+        struct stat st;
+        if (fstat(fd, &st) != 0) fail("cannot stat");
+        size_t size = static_cast<size_t>(st.st_size);
+        if (size == 0) {
+            map(storeInitialBytes);
+            std::memcpy(base, storeMagic, sizeof storeMagic);
+            end = storeHeaderBytes;
+            return;
+        }
+        if (size < storeHeaderBytes) throw std::runtime_error("Store " + path + ": not a store file");
+        map(size);
+        if (std::memcmp(base, storeMagic, sizeof storeMagic) != 0) {
+            throw std::runtime_error("Store " + path + ": not a store file");
+        }
+        scan();
+    }
+
+    // Replays the log into the index, stopping at the first record that is not whole
+    void scan() {
+        size_t at = storeHeaderBytes;
+        while (at + sizeof(RecordHeader) <= capacity) {
+            RecordHeader h;
+            std::memcpy(&h, base + at, sizeof h);
+            if (h.magic != recordMagic) break;
+            size_t valueBytes = h.valueBytes == tombstone ? 0 : h.valueBytes;
+            size_t data = at + sizeof h;
+            if (h.keyBytes > capacity - data || valueBytes > capacity - data - h.keyBytes) break;
+            if (recordChecksum(base + data, h.keyBytes, base + data + h.keyBytes, h.valueBytes) != h.checksum) break;
+            std::string key(base + data, h.keyBytes);
+            forget(key);
+            if (h.valueBytes == tombstone) deadBytes += sizeof h + h.keyBytes;
+            else index[key] = { data + h.keyBytes, valueBytes };
+            at = data + h.keyBytes + valueBytes;
+        }
+        end = at;
+        // Clear what a torn write left behind, so it cannot be mistaken for records later
+        if (end + sizeof(uint32_t) <= capacity) {
+            uint32_t next;
+            std::memcpy(&next, base + end, sizeof next);
+            if (next != 0) std::memset(base + end, 0, capacity - end);
+        }
+    }
+
+    // Counts the record holding the key's current value as dead and drops it from the index
+    void forget(const std::string& key) {
+        auto it = index.find(key);
+        if (it == index.end()) return;
+        deadBytes += sizeof(RecordHeader) + key.size() + it->second.second;
+        index.erase(it);
+    }
+
+    // Data first, header last: the record only exists once the header is in place
+    size_t append(const std::string& key, const std::string* value) {
+        size_t valueBytes = value ? value->size() : 0;
+        if (key.size() >= tombstone || valueBytes >= tombstone) throw std::runtime_error("Store " + path + ": record too large");
+        size_t need = sizeof(RecordHeader) + key.size() + valueBytes;
+        if (end + need > capacity) {
+            size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            size_t bytes = std::max(capacity * 2, end + need);
+            map((bytes + page - 1) / page * page);
+        }
+        size_t data = end + sizeof(RecordHeader);
+        std::memcpy(base + data, key.data(), key.size());
+        if (value) std::memcpy(base + data + key.size(), value->data(), valueBytes);
+        RecordHeader h;
+        h.magic = recordMagic;
+        h.keyBytes = static_cast<uint32_t>(key.size());
+        h.valueBytes = value ? static_cast<uint32_t>(valueBytes) : tombstone;
+        h.checksum = recordChecksum(base + data, h.keyBytes, base + data + key.size(), h.valueBytes);
+        std::memcpy(base + end, &h, sizeof h);
+        end += need;
+        return data + key.size();
+    }
+
+    void put(const std::string& key, const std::string& value) {
+        forget(key);
+        index[key] = { append(key, &value), value.size() };
+        compactIfWasteful();
+    }
+
+    bool del(const std::string& key) {
+        if (!index.count(key)) return false;
+        forget(key);
+        append(key, nullptr);
+        deadBytes += sizeof(RecordHeader) + key.size();
+        compactIfWasteful();
+        return true;
+    }
+
+    void compactIfWasteful() {
+        if (end < storeCompactMinimum || deadBytes * 2 < end) return;
+        KeyValueStore fresh;
+        fresh.path = path + ".compact";
+        unlink(fresh.path.c_str());
+        fresh.open();
+        for (auto& entry : index) {
+            std::string value(base + entry.second.first, entry.second.second);
+            fresh.index[entry.first] = { fresh.append(entry.first, &value), value.size() };
+        }
+        if (msync(fresh.base, fresh.end, MS_SYNC) != 0) fresh.fail("cannot write");
+        if (rename(fresh.path.c_str(), path.c_str()) != 0) fresh.fail("cannot replace " + path);
+        munmap(base, capacity);
+        close(fd);
+        std::swap(fd, fresh.fd);
+        std::swap(base, fresh.base);
+        std::swap(capacity, fresh.capacity);
+        std::swap(end, fresh.end);
+        std::swap(index, fresh.index);
+        deadBytes = 0;
+        fresh.base = nullptr;
+        fresh.fd = -1;
+    }
+};
+
+// One KeyValueStore per file, however often it is opened
+std::mutex storesMutex;
+std::map<std::string, std::weak_ptr<KeyValueStore>> openStores;
+
+KeyValueStore& storeArgument(const Cells& args, const char* name, size_t count) {
+    if (args.size() != count || args[0]->type != Store) {
+        throw std::runtime_error(std::string(name) + " expects a store and " + std::to_string(count - 1) +
+                                 (count == 2 ? " key" : " key and value"));
+    }
+    return *args[0]->store();
+}
+
+CellPtr openStore(const std::string& path) {
+    char resolved[PATH_MAX];
+    std::string key = realpath(path.c_str(), resolved) ? resolved : path;
+
+    std::lock_guard<std::mutex> lock(storesMutex);
+    std::shared_ptr<KeyValueStore> store = openStores[key].lock();
+    if (!store) {
+        store = std::make_shared<KeyValueStore>();
+        store->path = path;
+        store->open();
+        if (realpath(path.c_str(), resolved)) key = resolved;
+        openStores[key] = store;
+    }
+    auto cell = std::make_shared<Cell>(Store, "<Store " + path + ">");
+    cell->mutableStore() = store;
+    return cell;
+}
+
+CellPtr procStoreOpen(const Cells& args) {
+    if (args.size() != 1) throw std::runtime_error("store-open requires exactly one argument: a store file");
+    return openStore(pathArgument(args, 0, "store-open"));
+}
+
+CellPtr procStoreGet(const Cells& args) {
+    KeyValueStore& store = storeArgument(args, "store-get", 2);
+    std::string key;
+    encodeCell(args[1], key);
+    std::lock_guard<std::mutex> lock(store.mutex);
+    auto it = store.index.find(key);
+    if (it == store.index.end()) return std::make_shared<Cell>(Symbol, "nil");
+    const char* p = store.base + it->second.first;
+    return decodeCell(p, p + it->second.second);
+}
+
+CellPtr procStorePut(const Cells& args) {
+    KeyValueStore& store = storeArgument(args, "store-put", 3);
+    std::string key, value;
+    encodeCell(args[1], key);
+    encodeCell(args[2], value);
+    std::lock_guard<std::mutex> lock(store.mutex);
+    store.put(key, value);
+    return args[2];
+}
+
+CellPtr procStoreDel(const Cells& args) {
+    KeyValueStore& store = storeArgument(args, "store-del", 2);
+    std::string key;
+    encodeCell(args[1], key);
+    std::lock_guard<std::mutex> lock(store.mutex);
+    return std::make_shared<Cell>(Symbol, store.del(key) ? "t" : "nil");
+}
+
+////////////////////////////////////////////////////////////////////-FASL-//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// (write-fasl obj "file") saves a value in the binary encoding: a header, the
+// table of distinct symbols and numbers, then the value with its atoms as
+// indexes into the table. (read-fasl "file") maps the file and decodes straight
+// out of the mapping; each atom in the table becomes one Cell, shared by every
+// place it occurs, so a large literal costs about one allocation per list.
+const char faslMagic[8] = { 'Y', 'I', 'S', 'P', 'F', 'S', 'L', '1' };
+
+std::string encodeFasl(const CellPtr& value) {
+    AtomTable table;
+    std::string body;
+    encodeCell(value, body, &table);
+    std::string out(faslMagic, sizeof faslMagic);
+    putVarint(out, table.atoms.size());
+    for (auto& atom : table.atoms) encodeCell(atom, out);
+    return out + body;
+}
+
+CellPtr decodeFasl(const char* p, const char* end, const std::string& what) {
+    if (static_cast<size_t>(end - p) < sizeof faslMagic || std::memcmp(p, faslMagic, sizeof faslMagic) != 0) {
+        throw std::runtime_error("Not a fasl file: " + what);
+    }
+    p += sizeof faslMagic;
+    unsigned long count = getVarint(p, end);
+    if (count > static_cast<unsigned long>(end - p)) throw std::runtime_error("Corrupt encoded data: truncated");
+    Cells atoms;
+    atoms.reserve(count);
+    for (unsigned long i = 0; i < count; i++) {
+        atoms.push_back(decodeCell(p, end));
+        if (atoms.back()->type == List) throw std::runtime_error("Corrupt encoded data: bad atom");
+    }
+    CellPtr value = decodeCell(p, end, &atoms);
+    if (p != end) throw std::runtime_error("Corrupt encoded data: trailing bytes in " + what);
+    return value;
+}
+
+// Written beside the target and renamed over it, so no reader sees half a file;
+// the temporary name is unique, as processes may write the same cached module
+long writeFasl(const CellPtr& value, const std::string& path) {
+    static std::atomic<unsigned long> written{ 0 };
+    std::string data = encodeFasl(value);
+    std::string temporary = path + ".tmp" + std::to_string(getpid()) + "-" + std::to_string(written++);
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out.write(data.data(), static_cast<std::streamsize>(data.size())).flush()) {
+            unlink(temporary.c_str());
+            throw std::runtime_error("Cannot write " + temporary);
+        }
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        throw std::runtime_error("Cannot replace " + path + ": " + std::strerror(errno));
+    }
+    return static_cast<long>(data.size());
+}
+
+CellPtr readFasl(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("Cannot read " + path + ": " + std::strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Not a fasl file: " + path);
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) throw std::runtime_error("Cannot map " + path + ": " + std::strerror(errno));
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    struct Unmap {
+        void* p;
+        size_t size;
+        ~Unmap() { munmap(p, size); }
+    } unmap{ mapped, size };
+    const char* p = static_cast<const char*>(mapped);
+    return decodeFasl(p, p + size, path);
+}
+
+CellPtr procWriteFasl(const Cells& args) {
+    if (args.size() != 2) throw std::runtime_error("write-fasl requires a value and a file");
+    return makeNumber(writeFasl(args[0], pathArgument(args, 1, "write-fasl")));
+}
+
+CellPtr procReadFasl(const Cells& args) {
+    if (args.size() != 1) throw std::runtime_error("read-fasl requires exactly one argument: a fasl file");
+    return readFasl(pathArgument(args, 0, "read-fasl"));
+}
+
+/////////////////////////////////////////////////////////////////-MACROS-///////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// (defmacro name (params) body) binds the unevaluated argument forms to the
+// parameters and evaluates body to get the code that replaces the call. Each
+// call site is expanded once: when a Lambda is defined, the macro calls already
+// known in its body are expanded in a private copy of the body; any other call
+// is expanded the first time it is evaluated and the expansion is kept beside
+// the form, which stays as it was, since it may be data the program still
+// holds. Redefining a macro does not touch call sites that were already expanded.
+
+// A private copy of the expanded code, so later in-place expansions inside it
+// never write into data the macro body returned by reference
+CellPtr copyCode(const CellPtr& code) {
+    checkStack();
+    if (code->type != List) return code;
+    auto copy = std::make_shared<Cell>(List);
+    for (auto& e : code->list()) copy->mutableList().push_back(copyCode(e));
+    return copy;
+}
+
+CellPtr expandMacro(const CellPtr& macro, const CellPtr& form) {
+    const CellList& params = macro->list()[0]->list();
+    if (params.size() != form->list().size() - 1) {
+        throw std::runtime_error("Macro " + macro->val() + " expects " + std::to_string(params.size()) + " arguments");
+    }
+    EnvironmentPtr local = std::make_shared<Environment>(macro->env());
+    for (size_t i = 0; i < params.size(); i++) local->define(params[i]->val(), form->list()[i + 1]);
+    CellPtr code = eval(macro->list()[1], local);
+    if (code->type != List && code->type != Symbol && code->type != Number) {
+        throw std::runtime_error("Macro " + macro->val() + " must expand to code");
+    }
+    return copyCode(code);
+}
+
+// Expands the call in place, repeatedly while the result is itself a macro call;
+// the names of the macros used are added to `expanded`. Only for code no other
+// thread or data structure can see yet
+void expandInPlace(const CellPtr& form, CellPtr macro, const EnvironmentPtr& env, std::set<std::string>* expanded = nullptr) {
+    while (macro) {
+        if (expanded) expanded->insert(macro->val());
+        CellPtr code = expandMacro(macro, form);
+        form->become(*code);
+        macro = nullptr;
+        if (form->type == List && !form->list().empty() && form->list()[0]->type == Symbol) {
+            CellPtr next = env->lookup(form->list()[0]->val());
+            if (next && next->type == Macro) macro = next;
+        }
+    }
+}
+
+// Walks a private copy of a body that is being defined and expands the macro
+// calls in it, leaving quoted data, parameter lists and calls through shadowed
+// names alone
+void expandMacros(const CellPtr& expr, const EnvironmentPtr& env, const std::set<std::string>& shadowed,
+                  std::set<std::string>* expanded = nullptr) {
+    checkStack();
+    if (expr->type != List || expr->list().empty()) return;
+    const CellPtr& head = expr->list()[0];
+    if (head->type == Symbol) {
+        if (head->val() == "quote") return;
+        if ((head->val() == "define" || head->val() == "defmacro") && expr->list().size() == 4) {
+            std::set<std::string> inner = shadowed;
+            inner.insert(expr->list()[1]->val());
+            for (auto& p : expr->list()[2]->list()) inner.insert(p->val());
+            expandMacros(expr->list()[3], env, inner, expanded);
+            return;
+        }
+        if (!shadowed.count(head->val())) {
+            CellPtr macro = env->lookup(head->val());
+            if (macro && macro->type == Macro) {
+                try {
+                    expandInPlace(expr, macro, env, expanded);
+                } catch (const std::exception&) {
+                    return;  // Left for the first evaluation to report
+                }
+                expandMacros(expr, env, shadowed, expanded);
+                return;
+            }
+        }
+    }
+    for (auto& e : expr->list()) expandMacros(e, env, shadowed, expanded);
+}
+
+// True when the code still calls a macro; such bodies are expanded when they run
+bool hasMacroCalls(const CellPtr& expr, const EnvironmentPtr& env) {
+    checkStack();
+    if (expr->type != List || expr->list().empty()) return false;
+    const CellPtr& head = expr->list()[0];
+    if (head->type == Symbol) {
+        if (head->val() == "quote") return false;
+        CellPtr bound = env->lookup(head->val());
+        if (bound && bound->type == Macro) return true;
+    }
+    for (auto& e : expr->list()) {
+        if (hasMacroCalls(e, env)) return true;
+    }
+    return false;
+}
+
+const size_t expansionCapacity = 4096;
+
+struct Expansion {
+    std::weak_ptr<Cell> form;  // Tells a later form at the same address apart
+    CellPtr code;
+};
+
+struct ExpansionTable {
+    std::mutex mutex;
+    std::unordered_map<const Cell*, Expansion> byForm;
+};
+
+// Never destroyed, like the eval cache
+ExpansionTable& expansionTable() {
+    static ExpansionTable* table = new ExpansionTable;
+    return *table;
+}
+
+// The code a macro call evaluated at run time stands for, expanded the first time
+CellPtr expansionOf(const CellPtr& form, const CellPtr& macro) {
+    ExpansionTable& table = expansionTable();
+    {
+        std::lock_guard<std::mutex> lock(table.mutex);
+        auto it = table.byForm.find(form.get());
+        if (it != table.byForm.end() && it->second.form.lock() == form) return it->second.code;
+    }
+    // Macro bodies may evaluate anything, including other macro calls, so they run unlocked
+    CellPtr code = expandMacro(macro, form);
+    std::lock_guard<std::mutex> lock(table.mutex);
+    if (table.byForm.size() >= expansionCapacity) {
+        for (auto it = table.byForm.begin(); it != table.byForm.end();) {
+            it = it->second.form.expired() ? table.byForm.erase(it) : std::next(it);
+        }
+        if (table.byForm.size() >= expansionCapacity) table.byForm.clear();
+    }
+    // Another thread may have expanded the same call meanwhile; every caller runs the same code
+    auto it = table.byForm.find(form.get());
+    if (it != table.byForm.end() && it->second.form.lock() == form) return it->second.code;
+    table.byForm[form.get()] = Expansion{ form, code };
+    return code;
+}
+
+// The code with its macro calls replaced by the expansions eval runs for them;
+// code without macro calls is returned as it is
+CellPtr expandedCode(const CellPtr& expr, const EnvironmentPtr& env, const std::set<std::string>& shadowed) {
+    checkStack();
+    if (expr->type != List || expr->list().empty()) return expr;
+    const CellPtr& head = expr->list()[0];
+    if (head->type == Symbol) {
+        if (head->val() == "quote" || head->val() == "define" || head->val() == "defmacro") return expr;
+        if (!shadowed.count(head->val())) {
+            CellPtr macro = env->lookup(head->val());
+            if (macro && macro->type == Macro) return expandedCode(expansionOf(expr, macro), env, shadowed);
+        }
+    }
+    CellPtr copy;
+    const CellList& items = expr->list();
+    for (size_t i = 0; i < items.size(); i++) {
+        CellPtr e = expandedCode(items[i], env, shadowed);
+        if (e != items[i] && !copy) {
+            copy = std::make_shared<Cell>(List);
+            copy->mutableList().assign(items.begin(), items.begin() + i);
+        }
+        if (copy) copy->mutableList().push_back(e);
+    }
+    return copy ? copy : expr;
+}
+
+// The body of a Lambda as the tiers compile it: macros that became known after
+// the define are expanded like the interpreter expands them
+CellPtr tierBody(const CellPtr& func) {
+    std::set<std::string> shadowed;
+    for (auto& p : func->list()[0]->list()) shadowed.insert(p->val());
+    if (func->lambda() && func->lambda()->flatClosure) shadowed.insert(func->val());
+    return expandedCode(func->list()[1], func->env(), shadowed);
+}
+
+/////////////////////////////////////////////////////////////////-CLOSURES-//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// A Lambda defined inside a function body copies just the free variables of its
+// body into a small captured Environment that sits directly on the global one,
+// instead of keeping every frame of the enclosing calls alive. A frame only
+// changes through set, define, eval or load-native run in it, so the capture
+// falls back to the whole chain when an enclosing body could still rebind one
+// of the captured names, or when the code running in a frame is unknown.
+
+// True when any of `names` occurs anywhere in expr
+bool mentionsAny(const CellPtr& expr, std::initializer_list<const char*> names) {
+    checkStack();
+    if (expr->type == Symbol) {
+        for (const char* n : names) {
+            if (expr->val() == n) return true;
+        }
+        return false;
+    }
+    for (auto& e : expr->list()) {
+        if (mentionsAny(e, names)) return true;
+    }
+    return false;
+}
+
+// Every symbol the body may look up; quoted data is skipped
+void collectSymbols(const CellPtr& expr, std::set<std::string>& names) {
+    checkStack();
+    if (expr->type == Symbol) {
+        names.insert(expr->val());
+        return;
+    }
+    if (!expr->list().empty() && expr->list()[0]->type == Symbol && expr->list()[0]->val() == "quote") return;
+    for (auto& e : expr->list()) collectSymbols(e, names);
+}
+
+void collectDefines(const CellPtr& expr, std::set<std::string>& names) {
+    checkStack();
+    if (expr->type != List) return;
+    const CellList& l = expr->list();
+    if (l.size() >= 2 && l[0]->type == Symbol && l[0]->val() == "define") names.insert(l[1]->val());
+    for (auto& e : l) collectDefines(e, names);
+}
+
+const LambdaData& frameInfo(const CellPtr& owner) {
+    LambdaData& data = *owner->lambda();
+    std::call_once(data.frameInfoOnce, [&]() {
+        data.rebindsFrame = mentionsAny(owner->list()[1], { "set", "eval", "load-native", "load" });
+        collectDefines(owner->list()[1], data.frameDefines);
+    });
+    return data;
+}
+
+// The environment a Lambda defined in env should keep; flat is set when it is a capture
+EnvironmentPtr captureEnvironment(const CellPtr& params, const CellPtr& body, const std::string& name,
+                                  const EnvironmentPtr& env, bool& flat) {
+    flat = false;
+    if (!env->outer || params->type != List) return env;
+    if (mentionsAny(body, { "eval", "load-native", "load" }) || hasMacroCalls(body, env)) return env;
+
+    std::set<std::string> free;
+    collectSymbols(body, free);
+    for (auto& p : params->list()) free.erase(p->val());
+    free.erase(name);
+
+    EnvironmentPtr global = env;
+    while (global->outer) global = global->outer;
+    for (Environment* e = env.get(); e != global.get(); e = e->outer.get()) {
+        if (e->captured) continue;
+        if (!e->owner || !e->owner->lambda()) return env;
+        const LambdaData& info = frameInfo(e->owner);
+        if (info.rebindsFrame) return env;
+        for (auto& n : free) {
+            if (info.frameDefines.count(n)) return env;
+        }
+    }
+
+    EnvironmentPtr captured = std::make_shared<Environment>(global);
+    for (Environment* e = env.get(); e != global.get(); e = e->outer.get()) {
+        for (auto it = free.begin(); it != free.end();) {
+            auto found = e->symbols.find(*it);
+            if (found == e->symbols.end()) {
+                ++it;
+                continue;
+            }
+            captured->define(*it, found->second);
+            it = free.erase(it);
+        }
+    }
+    captured->captured = true;
+    flat = true;
+    return captured;
+}
+
+// A fresh frame for a call of func; parameters are bound by the caller
+EnvironmentPtr callFrame(const CellPtr& func) {
+    EnvironmentPtr frame = std::make_shared<Environment>(func->env());
+    frame->owner = func;
+    // Before the parameters, so a parameter of the same name still wins
+    if (func->lambda() && func->lambda()->flatClosure) frame->define(func->val(), func);
+    return frame;
+}
+
+/////////////////////////////////////////////////////////////-SPECIALIZATION-////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Every call of a Lambda records the CellTypes of its arguments. Once it has been
+// called specThreshold times with nothing but numbers, its body is rebuilt as a
+// tree of typed nodes: the Number check happens once per argument at the entry,
+// and arithmetic and comparisons on parameters and literals work on longs without
+// allocating Cells. Forms the tree does not cover are left to eval in an ordinary
+// Environment, created on first use. A call with any other argument type
+// deoptimizes the Lambda back to the interpreter for good.
+bool specializeEnabled = true;
+long specThreshold = 20;
+
+struct SpecNode {
+    enum Kind { Const, Param, Arith, Compare, Not, If, And, Or, SelfCall, Generic };
+    enum Type { Int, Bool, Any };
+
+    Kind kind;
+    Type type;
+    Primitive prim = nullptr;  // Arith and Compare
+    long value = 0;            // Const value or Param index
+    CellPtr expr;              // The source form; evaluated by Generic, returned by an Int Const
+    std::vector<std::unique_ptr<SpecNode>> args;
+
+    SpecNode(Kind kind, Type type, const CellPtr& expr) : kind(kind), type(type), expr(expr) {}
+};
+
+LambdaData::~LambdaData() {
+    if (jitCode) munmap(reinterpret_cast<void*>(jitCode), jitSize);
+}
+
+struct SpecBuilder {
+    const CellPtr& func;
+    EnvironmentPtr env;
+    SpecNode::Type selfType;  // Assumed result type of a recursive call
+    std::set<std::string> assumed;  // Operators whose binding the tree depends on
+
+    SpecBuilder(const CellPtr& func, SpecNode::Type selfType) : func(func), env(func->env()), selfType(selfType) {}
+
+    int paramIndex(const std::string& name) {
+        const CellList& params = func->list()[0]->list();
+        for (size_t i = 0; i < params.size(); i++) {
+            if (params[i]->val() == name) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // True when `op` still means the special form at run time
+    bool isForm(const std::string& op, const char* name) {
+        if (op != name || paramIndex(op) >= 0) return false;
+        CellPtr bound = env->lookup(op);
+        return !bound || bound->type != Proc;
+    }
+
+    std::unique_ptr<SpecNode> node(SpecNode::Kind kind, SpecNode::Type type, const CellPtr& expr) {
+        return std::unique_ptr<SpecNode>(new SpecNode(kind, type, expr));
+    }
+
+    std::unique_ptr<SpecNode> generic(const CellPtr& expr) {
+        return node(SpecNode::Generic, SpecNode::Any, expr);
+    }
+
+    std::unique_ptr<SpecNode> boolean(bool value, const CellPtr& expr) {
+        auto n = node(SpecNode::Const, SpecNode::Bool, expr);
+        n->value = value;
+        return n;
+    }
+
+    // if and cond share one node shape: test, then, else
+    std::unique_ptr<SpecNode> conditional(std::unique_ptr<SpecNode> test, std::unique_ptr<SpecNode> then,
+                                          std::unique_ptr<SpecNode> otherwise, const CellPtr& expr) {
+        SpecNode::Type type = then->type == otherwise->type ? then->type : SpecNode::Any;
+        auto n = node(SpecNode::If, type, expr);
+        n->args.push_back(std::move(test));
+        n->args.push_back(std::move(then));
+        n->args.push_back(std::move(otherwise));
+        return n;
+    }
+
+    std::unique_ptr<SpecNode> build(const CellPtr& expr) {
+        checkStack();
+        if (expr->type == Number) {
+            auto n = node(SpecNode::Const, SpecNode::Int, expr);
+            n->value = numberValue(expr);
+            return n;
+        }
+        if (expr->type == Symbol) {
+            int idx = paramIndex(expr->val());
+            if (idx < 0) return generic(expr);
+            auto n = node(SpecNode::Param, SpecNode::Int, expr);
+            n->value = idx;
+            return n;
+        }
+        if (expr->type != List || expr->list().empty() || expr->list()[0]->type != Symbol) return generic(expr);
+
+        const CellList& l = expr->list();
+        const std::string& op = l[0]->val();
+        if (paramIndex(op) >= 0) return generic(expr);
+        assumed.insert(op);
+
+        if (isForm(op, "if")) {
+            if (l.size() < 3) return generic(expr);
+            return conditional(build(l[1]), build(l[2]), l.size() > 3 ? build(l[3]) : boolean(false, expr), expr);
+        }
+        if (isForm(op, "cond")) {
+            for (size_t i = 1; i < l.size(); i++) {
+                if (l[i]->type != List || l[i]->list().size() != 2) return generic(expr);
+            }
+            // Nested ifs from the last clause outwards; no match gives nil
+            std::unique_ptr<SpecNode> tail = boolean(false, expr);
+            for (size_t i = l.size() - 1; i >= 1; i--) {
+                tail = conditional(build(l[i]->list()[0]), build(l[i]->list()[1]), std::move(tail), expr);
+            }
+            return tail;
+        }
+        if (isForm(op, "and") || isForm(op, "or")) {
+            if (l.size() < 3) return generic(expr);
+            auto second = build(l[2]);
+            auto n = node(op == "and" ? SpecNode::And : SpecNode::Or,
+                          second->type == SpecNode::Bool ? SpecNode::Bool : SpecNode::Any, expr);
+            n->args.push_back(build(l[1]));
+            n->args.push_back(std::move(second));
+            return n;
+        }
+
+        size_t argc = l.size() - 1;
+        Primitive prim = numericPrimitive(op, env, argc);
+        if (prim == procNot) {
+            if (argc != 1) return generic(expr);
+            auto n = node(SpecNode::Not, SpecNode::Bool, expr);
+            n->args.push_back(build(l[1]));
+            return n;
+        }
+        if (prim) {
+            bool compare = prim == procGreaterThan || prim == procLessThan || prim == procEquals ||
+                           prim == procGreaterEqual || prim == procLessEqual;
+            // Arity errors are left to the primitive itself
+            bool arity = compare ? argc == 2 : prim == procMod ? argc == 2 : prim == procDiv ? argc >= 2
+                       : prim == procSub ? argc >= 1 : true;
+            if (!arity) return generic(expr);
+            auto n = node(compare ? SpecNode::Compare : SpecNode::Arith, compare ? SpecNode::Bool : SpecNode::Int, expr);
+            n->prim = prim;
+            for (size_t i = 1; i < l.size(); i++) n->args.push_back(build(l[i]));
+            return n;
+        }
+
+        bool self = func->lambda()->flatClosure || env->lookup(op) == func;
+        if (op == func->val() && argc == func->list()[0]->list().size() && self) {
+            auto n = node(SpecNode::SelfCall, selfType, expr);
+            for (size_t i = 1; i < l.size(); i++) {
+                n->args.push_back(build(l[i]));
+                if (n->args.back()->type != SpecNode::Int) return generic(expr);
+            }
+            return n;
+        }
+        return generic(expr);
+    }
+};
+
+std::unique_ptr<SpecNode> specialize(const CellPtr& func) {
+    const CellList& params = func->list()[0]->list();
+    if (params.size() > tierMaxParams) return nullptr;
+    for (auto& p : params) {
+        if (p->type != Symbol) return nullptr;
+    }
+    CellPtr body = tierBody(func);
+    if (mentionsAny(body, { "set", "define", "eval", "profile", "load-native", "load" })) return nullptr;
+
+    // Assume recursive calls return numbers; if the body does not, build again without that assumption
+    SpecBuilder typed(func, SpecNode::Int);
+    std::unique_ptr<SpecNode> tree = typed.build(body);
+    std::set<std::string> assumed = typed.assumed;
+    if (tree->type != SpecNode::Int) {
+        SpecBuilder untyped(func, SpecNode::Any);
+        tree = untyped.build(body);
+        assumed = untyped.assumed;
+    }
+    if (tree->kind == SpecNode::Generic) return nullptr;
+    assumeBindings(func, assumed);
+    return tree;
+}
+
+void specCompile(const CellPtr& func) {
+    LambdaData& data = *func->lambda();
+    int idle = TierIdle;
+    if (!data.specState.compare_exchange_strong(idle, TierCompiling)) return;
+    std::unique_ptr<SpecNode> tree;
+    try {
+        tree = specialize(func);
+    } catch (const std::exception&) {
+        // A literal that does not fit a long or a macro call that does not expand
+    }
+    data.spec = std::move(tree);
+    data.specState.store(data.spec ? TierReady : TierRejected, std::memory_order_release);
+}
+
+// Retired trees a call on this thread may still be running in: one further up
+// the stack, whose body reached a rebinding through eval, or one a green task is
+// parked in. Global bindings only change while no other thread evaluates (they
+// are batch barriers), so the calls of this thread are the only ones to wait for.
+struct RetiredSpecs {
+    long running = 0;  // Calls in a specialized tree on this thread, in every green task
+    std::vector<std::unique_ptr<SpecNode>> trees;
+};
+
+thread_local RetiredSpecs retiredSpecs;
+
+// Marks a call running in a specialized tree; the retired trees go with the last one
+struct SpecCall {
+    SpecCall() { retiredSpecs.running++; }
+    ~SpecCall() {
+        if (--retiredSpecs.running == 0) retiredSpecs.trees.clear();
+    }
+};
+
+// Sends a Lambda back to the interpreter, to be profiled afresh
+void retireTiers(LambdaData& data) {
+    if (data.spec && retiredSpecs.running > 0) retiredSpecs.trees.push_back(std::move(data.spec));
+    data.spec.reset();
+    // Native code never calls back into the interpreter, so none can be running here
+    if (data.jitCode) munmap(reinterpret_cast<void*>(data.jitCode), data.jitSize);
+    data.jitCode = nullptr;
+    data.jitSize = 0;
+    data.jitState.store(TierIdle, std::memory_order_relaxed);
+    data.specState.store(TierIdle, std::memory_order_relaxed);
+    data.calls.store(0, std::memory_order_relaxed);
+    for (auto& t : data.argTypes) t.store(0, std::memory_order_relaxed);
+}
+
+void clearEvalCache();
+
+// Called once set, define, defmacro or a module has bound `name` in the global
+// Environment; the tiers and the prepared eval forms that resolved it ahead are
+// dropped. Bindings in a frame only matter to Lambdas defined in it, which stay
+// interpreted unless the frame was flattened into a capture that never changes.
+void bindingChanged(const std::string& name) {
+    std::vector<std::weak_ptr<Cell>> users;
+    {
+        TierAssumptions& a = tierAssumptions();
+        std::lock_guard<std::mutex> lock(a.mutex);
+        auto it = a.users.find(name);
+        if (it == a.users.end()) return;
+        users.swap(it->second);
+        a.users.erase(it);
+    }
+    bool live = false;
+    for (auto& u : users) {
+        CellPtr user = u.lock();
+        live = live || user;
+        if (user && user->type == Lambda && user->lambda()) retireTiers(*user->lambda());
+    }
+    // Entries of the eval cache are not tracked one by one
+    if (live) clearEvalCache();
+}
+
+struct SpecFrame {
+    const CellPtr& func;
+    const long* values;
+    const Cells* cells;  // Argument Cells when called from eval, nullptr for recursive calls
+    EnvironmentPtr env;
+
+    CellPtr argument(size_t i) {
+        return cells ? (*cells)[i] : makeNumber(values[i]);
+    }
+
+    const EnvironmentPtr& environment() {
+        if (!env) {
+            env = callFrame(func);
+            const CellList& params = func->list()[0]->list();
+            for (size_t i = 0; i < params.size(); i++) env->define(params[i]->val(), argument(i));
+        }
+        return env;
+    }
+};
+
+long specInt(const SpecNode& n, SpecFrame& frame);
+bool specBool(const SpecNode& n, SpecFrame& frame);
+CellPtr specAny(const SpecNode& n, SpecFrame& frame);
+CellPtr interpretCall(const CellPtr& func, const Cells& args);
+
+// The tree of a recursive call is looked up at every call: a rebinding may have retired it meanwhile
+const SpecNode* currentSpec(const CellPtr& func) {
+    LambdaData& data = *func->lambda();
+    return data.specState.load(std::memory_order_acquire) == TierReady ? data.spec.get() : nullptr;
+}
+
+CellPtr interpretCallee(SpecFrame& callee) {
+    Cells args;
+    for (size_t i = 0; i < callee.func->list()[0]->list().size(); i++) args.push_back(callee.argument(i));
+    return interpretCall(callee.func, args);
+}
+
+CellPtr truthCell(bool value) {
+    return std::make_shared<Cell>(Symbol, value ? "t" : "nil");
+}
+
+bool specTest(const SpecNode& n, SpecFrame& frame) {
+    if (n.type == SpecNode::Int) {
+        specInt(n, frame);
+        return true;
+    }
+    if (n.type == SpecNode::Bool) return specBool(n, frame);
+    return isTrue(specAny(n, frame));
+}
+
+// Folds the operands of an Arith or Compare node; false when the primitive has to
+// decide instead (a non-number operand, division by zero or overflow of LONG_MIN / -1)
+bool specNumbers(const SpecNode& n, SpecFrame& frame, long* values, Cells& cells) {
+    bool numbers = true;
+    for (size_t i = 0; i < n.args.size(); i++) {
+        const SpecNode& a = *n.args[i];
+        if (a.type == SpecNode::Int) {
+            values[i] = specInt(a, frame);
+            if (!numbers) cells.push_back(makeNumber(values[i]));
+            continue;
+        }
+        CellPtr c = specAny(a, frame);
+        if (numbers && c->type == Number) {
+            values[i] = numberValue(c);
+            continue;
+        }
+        if (numbers) {
+            for (size_t j = 0; j < i; j++) cells.push_back(makeNumber(values[j]));
+            numbers = false;
+        }
+        cells.push_back(c);
+    }
+    return numbers;
+}
+
+long specArith(const SpecNode& n, SpecFrame& frame) {
+    std::vector<long> values(n.args.size());
+    Cells cells;
+    if (specNumbers(n, frame, values.data(), cells)) {
+        size_t count = values.size();
+        if (n.prim == procAdd || n.prim == procMul) {
+            long r = n.prim == procAdd ? 0 : 1;
+            for (long v : values) r = n.prim == procAdd ? r + v : r * v;
+            return r;
+        }
+        if (n.prim == procSub) {
+            long r = values[0];
+            if (count == 1) return -r;
+            for (size_t i = 1; i < count; i++) r -= values[i];
+            return r;
+        }
+        bool safe = true;
+        for (size_t i = 1; i < count; i++) safe = safe && values[i] != 0 && values[i] != -1;
+        if (safe) {
+            long r = values[0];
+            if (n.prim == procMod) return r % values[1];
+            for (size_t i = 1; i < count; i++) r /= values[i];
+            return r;
+        }
+        for (long v : values) cells.push_back(makeNumber(v));
+    }
+    return numberValue(n.prim(cells));
+}
+
+bool specCompare(const SpecNode& n, SpecFrame& frame) {
+    long values[2];
+    Cells cells;
+    if (specNumbers(n, frame, values, cells)) {
+        if (n.prim == procGreaterThan) return values[0] > values[1];
+        if (n.prim == procLessThan) return values[0] < values[1];
+        if (n.prim == procEquals) return values[0] == values[1];
+        if (n.prim == procGreaterEqual) return values[0] >= values[1];
+        return values[0] <= values[1];
+    }
+    return isTrue(n.prim(cells));
+}
+
+// A recursive call: the arguments are already longs, so no guard is needed. Still
+// counted, so a recursive Lambda reaches the native tier within its first call.
+SpecFrame specCallee(const SpecNode& n, SpecFrame& frame, long* values) {
+    checkStack();
+    LambdaData& data = *frame.func->lambda();
+    if (jitEnabled && data.jitState.load(std::memory_order_relaxed) == TierIdle &&
+        data.calls.fetch_add(1, std::memory_order_relaxed) + 1 >= jitThreshold) {
+        jitCompile(frame.func);
+    }
+    for (size_t i = 0; i < n.args.size(); i++) values[i] = specInt(*n.args[i], frame);
+    return SpecFrame{ frame.func, values, nullptr, nullptr };
+}
+
+long specInt(const SpecNode& n, SpecFrame& frame) {
+    switch (n.kind) {
+    case SpecNode::Const: return n.value;
+    case SpecNode::Param: return frame.values[n.value];
+    case SpecNode::Arith: return specArith(n, frame);
+    case SpecNode::If:
+        return specTest(*n.args[0], frame) ? specInt(*n.args[1], frame) : specInt(*n.args[2], frame);
+    case SpecNode::SelfCall: {
+        long values[tierMaxParams];
+        SpecFrame callee = specCallee(n, frame, values);
+        const SpecNode* tree = currentSpec(frame.func);
+        return tree ? specInt(*tree, callee) : numberValue(interpretCallee(callee));
+    }
+    default: return numberValue(specAny(n, frame));
+    }
+}
+
+bool specBool(const SpecNode& n, SpecFrame& frame) {
+    switch (n.kind) {
+    case SpecNode::Const: return n.value != 0;
+    case SpecNode::Compare: return specCompare(n, frame);
+    case SpecNode::Not: return !specTest(*n.args[0], frame);
+    case SpecNode::If:
+        return specTest(*n.args[0], frame) ? specBool(*n.args[1], frame) : specBool(*n.args[2], frame);
+    case SpecNode::And: return specTest(*n.args[0], frame) && specBool(*n.args[1], frame);
+    case SpecNode::Or: return specTest(*n.args[0], frame) || specBool(*n.args[1], frame);
+    default: return isTrue(specAny(n, frame));
+    }
+}
+
+CellPtr specAny(const SpecNode& n, SpecFrame& frame) {
+    switch (n.kind) {
+    case SpecNode::Const: return n.type == SpecNode::Int ? n.expr : truthCell(n.value != 0);
+    case SpecNode::Param: return frame.argument(n.value);
+    case SpecNode::Generic: return eval(n.expr, frame.environment());
+    case SpecNode::If:
+        return specTest(*n.args[0], frame) ? specAny(*n.args[1], frame) : specAny(*n.args[2], frame);
+    case SpecNode::And:
+        if (!specTest(*n.args[0], frame)) return truthCell(false);
+        return specAny(*n.args[1], frame);
+    case SpecNode::Or:
+        if (specTest(*n.args[0], frame)) return truthCell(true);
+        return specAny(*n.args[1], frame);
+    case SpecNode::SelfCall:
+        if (n.type == SpecNode::Any) {
+            long values[tierMaxParams];
+            SpecFrame callee = specCallee(n, frame, values);
+            const SpecNode* tree = currentSpec(frame.func);
+            return tree ? specAny(*tree, callee) : interpretCallee(callee);
+        }
+        break;
+    default: break;
+    }
+    if (n.type == SpecNode::Int) return makeNumber(specInt(n, frame));
+    return truthCell(specBool(n, frame));
+}
+
+// Binds already evaluated arguments and runs the body in the interpreter
+CellPtr interpretCall(const CellPtr& func, const Cells& args) {
+    EnvironmentPtr localEnv = callFrame(func);
+    const CellList& params = func->list()[0]->list();
+    for (size_t i = 0; i < args.size(); ++i) localEnv->define(params[i]->val(), args[i]);
+    return eval(func->list()[1], localEnv);
+}
+
+// Calls a Lambda through the fastest tier that applies: native code, the
+// specialized tree, or the interpreter. Feeds the type profile while the tiers
+// are still undecided.
+CellPtr callTiered(const CellPtr& func, const Cells& args) {
+    // The faster tiers do not go through eval, so they would not be charged
+    if (evalLimits.active) return interpretCall(func, args);
+
+    LambdaData& data = *func->lambda();
+    bool numbers = true;
+    for (auto& a : args) numbers = numbers && a->type == Number;
+
+    int jit = data.jitState.load(std::memory_order_acquire);
+    int spec = data.specState.load(std::memory_order_acquire);
+    if ((jitEnabled && jit == TierIdle) || (specializeEnabled && spec == TierIdle)) {
+        bool monomorphic = true;
+        for (size_t i = 0; i < args.size() && i < tierMaxParams; i++) {
+            unsigned bit = 1u << args[i]->type;
+            unsigned seen = data.argTypes[i].load(std::memory_order_relaxed);
+            if (!(seen & bit)) seen = data.argTypes[i].fetch_or(bit, std::memory_order_relaxed) | bit;
+            monomorphic = monomorphic && seen == (1u << Number);
+        }
+        long calls = data.calls.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (jitEnabled && jit == TierIdle && calls >= jitThreshold) jitCompile(func);
+        if (specializeEnabled && spec == TierIdle && calls >= specThreshold) {
+            if (monomorphic) specCompile(func);
+            else data.specState.store(TierRejected, std::memory_order_relaxed);
+        }
+        jit = data.jitState.load(std::memory_order_acquire);
+        spec = data.specState.load(std::memory_order_acquire);
+    }
+
+    if (numbers) {
+        if (jit == TierReady && jitEnabled && !jitSuspended) {
+            CellPtr result;
+            if (jitCall(func, args, result)) return result;
+
+            // Native code stays off until the interpreter has finished this call, so a
+            // deep recursion that ran out of native depth is not retried at every level
+            struct Suspend {
+                Suspend() { jitSuspended++; }
+                ~Suspend() { jitSuspended--; }
+            } suspend;
+            return interpretCall(func, args);
+        }
+        if (spec == TierReady && specializeEnabled) {
+            long values[tierMaxParams];
+            for (size_t i = 0; i < args.size(); i++) values[i] = numberValue(args[i]);
+            SpecFrame frame{ func, values, &args, nullptr };
+            SpecCall running;
+            return specAny(*data.spec, frame);
+        }
+    } else if (spec == TierReady) {
+        // The guard failed: this Lambda is not monomorphic after all
+        data.specState.store(TierRejected, std::memory_order_relaxed);
+    }
+    return interpretCall(func, args);
+}
+
+// Calls a Proc or Lambda with arguments that are already evaluated
+CellPtr applyProcedure(const CellPtr& func, const Cells& args) {
+    if (func->type == Proc) return func->proc()(args);
+    if (func->type != Lambda) throw std::runtime_error("Unknown function or expression");
+    if (func->list().size() < 2) {
+        throw std::runtime_error("Malformed function definition");
+    }
+    CellPtr params = func->list()[0];
+    if (params->list().size() != args.size()) {
+        throw std::runtime_error("Argument count mismatch");
+    }
+    // Functions handed to map and friends are hot too
+    if (func->lambda() && !profilingEnabled) return callTiered(func, args);
+    EnvironmentPtr localEnv = callFrame(func);
+    for (size_t i = 0; i < args.size(); ++i) {
+        localEnv->define(params->list()[i]->val(), args[i]);
+    }
+    if (profilingEnabled) {
+        ProfileScope scope(func->val().empty() ? "<lambda>" : func->val());
+        return eval(func->list()[1], localEnv);
+    }
+    return eval(func->list()[1], localEnv);
+}
+
+//////////////////////////////////////////////////////////////-EVAL CACHE-//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// (eval form) looks the form up before running it: by identity first, then by a
+// structural hash, so a freshly built list of a shape seen before is found too.
+// The second time a shape is seen, a private copy of it is prepared: its macro
+// calls are expanded once and, at the top level, it is specialized like the body
+// of a Lambda without parameters; shapes seen once are just evaluated. Atoms that are not code, like functions and
+// channels, only match themselves. Binding a name a prepared form resolved
+// ahead, an operator or a macro, drops the whole cache.
+const size_t evalCacheCapacity = 4096;
+
+struct PreparedForm {
+    CellPtr shape;  // Copy of the form as it was evaluated, compared on hash hits
+    CellPtr code;   // Copy that is run, with its macro calls expanded
+    CellPtr thunk;  // Zero-parameter Lambda over code with a specialized tree, or nullptr
+};
+
+struct EvalCacheEntry {
+    std::weak_ptr<Cell> source;
+    std::shared_ptr<PreparedForm> prepared;
+};
+
+struct EvalCache {
+    std::mutex mutex;
+    std::unordered_multimap<size_t, std::shared_ptr<PreparedForm>> byShape;
+    std::unordered_map<const Cell*, EvalCacheEntry> byIdentity;
+    std::unordered_set<size_t> seenOnce;  // Hashes of shapes not prepared yet
+};
+
+// Never destroyed, so no Cells are freed after the heap counters of the main thread are gone
+EvalCache& evalCache() {
+    static EvalCache* cache = new EvalCache;
+    return *cache;
+}
+
+size_t hashCode(const CellPtr& code) {
+    checkStack();
+    size_t h = static_cast<size_t>(code->type) * 0x9e3779b97f4a7c15ull;
+    if (code->type == Number) return h ^ std::hash<long>()(code->number);
+    if (code->type == Symbol || (code->type == String && code->list().empty())) {
+        return h ^ std::hash<std::string>()(code->val());
+    }
+    if (code->type != List) return h ^ std::hash<const Cell*>()(code.get());
+    for (auto& e : code->list()) h = (h ^ hashCode(e)) * 0x100000001b3ull;
+    return h;
+}
+
+bool sameCode(const CellPtr& a, const CellPtr& b) {
+    checkStack();
+    if (a == b) return true;
+    if (a->type != b->type) return false;
+    if (a->type == Number) return a->number == b->number;
+    if (a->type == Symbol) return a->val() == b->val();
+    if (a->type == String && a->list().empty() && b->list().empty()) return a->val() == b->val();
+    if (a->type != List || a->list().size() != b->list().size()) return false;
+    for (size_t i = 0; i < a->list().size(); i++) {
+        if (!sameCode(a->list()[i], b->list()[i])) return false;
+    }
+    return true;
+}
+
+std::shared_ptr<PreparedForm> prepare(const CellPtr& form, const EnvironmentPtr& env) {
+    auto prepared = std::make_shared<PreparedForm>();
+    prepared->shape = copyCode(form);
+    prepared->code = copyCode(form);
+    if (env->outer) return prepared;
+
+    // Macros are only resolved ahead against the global Environment; elsewhere a
+    // local binding may shadow them, so eval expands the calls when it reaches them
+    std::set<std::string> expanded;
+    expandMacros(prepared->code, env, {}, &expanded);
+    assumeBindings(prepared->code, expanded);
+    if (!specializeEnabled) return prepared;
+    auto thunk = std::make_shared<Cell>(Lambda);
+    thunk->mutableList().push_back(std::make_shared<Cell>(List));
+    thunk->mutableList().push_back(prepared->code);
+    thunk->mutableEnv() = env;
+    thunk->mutableLambda().reset(new LambdaData());
+    try {
+        thunk->lambda()->spec = specialize(thunk);
+    } catch (const std::exception&) {
+        // A literal that does not fit a long
+    }
+    if (thunk->lambda()->spec) {
+        thunk->lambda()->specState.store(TierReady, std::memory_order_release);
+        prepared->thunk = thunk;
+    }
+    return prepared;
+}
+
+std::shared_ptr<PreparedForm> preparedForm(const CellPtr& form, const EnvironmentPtr& env) {
+    EvalCache& cache = evalCache();
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto it = cache.byIdentity.find(form.get());
+        if (it != cache.byIdentity.end() && it->second.source.lock() == form) {
+            return it->second.prepared;
+        }
+    }
+
+    size_t hash = hashCode(form);
+    std::shared_ptr<PreparedForm> prepared;
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto range = cache.byShape.equal_range(hash);
+        for (auto it = range.first; it != range.second && !prepared; ++it) {
+            if (sameCode(it->second->shape, form)) prepared = it->second;
+        }
+    }
+    if (!prepared) {
+        {
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            if (cache.seenOnce.size() >= 4 * evalCacheCapacity) cache.seenOnce.clear();
+            if (cache.seenOnce.insert(hash).second) return nullptr;
+            cache.seenOnce.erase(hash);
+        }
+        // Preparing can run macro bodies, which may eval in turn, so it happens unlocked
+        prepared = prepare(form, env);
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        if (cache.byShape.size() >= evalCacheCapacity) {
+            cache.byShape.clear();
+            cache.byIdentity.clear();
+        }
+        cache.byShape.emplace(hash, prepared);
+    }
+
+    // A form nothing else holds, like a list consed just for this eval, cannot come back
+    if (form.use_count() == 1) return prepared;
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (cache.byIdentity.size() >= 4 * evalCacheCapacity) cache.byIdentity.clear();
+    cache.byIdentity[form.get()] = EvalCacheEntry{ form, prepared };
+    return prepared;
+}
+
+void clearEvalCache() {
+    EvalCache& cache = evalCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.byShape.clear();
+    cache.byIdentity.clear();
+    cache.seenOnce.clear();
+}
+
+CellPtr evalForm(const CellPtr& form, const EnvironmentPtr& env) {
+    if (form->type != List || form->list().empty()) return eval(form, env);
+    std::shared_ptr<PreparedForm> prepared = preparedForm(form, env);
+    if (!prepared) return eval(form, env);
+    // The specialized tree is not charged steps, so it is skipped under limits
+    const CellPtr& thunk = prepared->thunk;
+    const SpecNode* tree = thunk ? currentSpec(thunk) : nullptr;
+    if (tree && thunk->env() == env && specializeEnabled && !evalLimits.active) {
+        SpecFrame frame{ thunk, nullptr, nullptr, env };
+        SpecCall running;
+        return specAny(*tree, frame);
+    }
+    return eval(prepared->code, env);
+}
+
+////////////////////////////////////////////////////////////-NATIVE MODULES-//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// What the interpreter hands to a module built by yispc. Calls from compiled code
+// into interpreted functions go through these so they run on the interpreter's eval.
+struct YispModuleHost {
+    EnvironmentPtr env;
+    CellPtr (*eval)(CellPtr, EnvironmentPtr);
+    CellPtr (*apply)(const CellPtr&, const Cells&);
+};
+
+using YispModuleRegister = int (*)(const YispModuleHost&);
+
+EnvironmentPtr globalEnvOf(EnvironmentPtr env) {
+    while (env->outer) env = env->outer;
+    return env;
+}
+
+// dlopens a module and lets it register its functions as Proc cells
+int loadNativeModule(const std::string& path, EnvironmentPtr env) {
+    std::string file = path.find('/') == std::string::npos ? "./" + path : path;
+    void* handle = dlopen(file.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        throw std::runtime_error(std::string("Cannot load module: ") + dlerror());
+    }
+    auto registerModule = reinterpret_cast<YispModuleRegister>(dlsym(handle, "yisp_module_register"));
+    if (!registerModule) {
+        throw std::runtime_error("Not a yispc module: " + path);
+    }
+    // The handle is never closed; Proc cells keep pointing into the module
+    EnvironmentPtr global = globalEnvOf(env);
+    std::map<std::string, CellPtr> before = global->symbols;
+    int registered = registerModule({ global, eval, applyProcedure });
+    for (auto& binding : global->symbols) {
+        auto it = before.find(binding.first);
+        if (it == before.end() || it->second != binding.second) bindingChanged(binding.first);
+    }
+    return registered;
+}
+
+CellPtr procLoadNative(const Cells& args, const EnvironmentPtr& global) {
+    if (args.size() != 1) throw std::runtime_error("load-native requires exactly one argument: a module file");
+    return makeNumber(loadNativeModule(pathArgument(args, 0, "load-native"), global));
+}
+
+//////////////////////////////////////////////////////////////-HOT RELOAD-//////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// (watch "file") evaluates every top-level form of a file in the global
+// Environment and keeps watching the file through inotify. When it is written
+// again, only the forms whose tokens changed are evaluated, in file order, along
+// with forms that call a macro the change redefined, so those call sites are
+// expanded anew. Functions whose bodies mention a rebound name lose their
+// specialized tree and native code and are profiled afresh, and the eval cache
+// is emptied. Changes are picked up before each line the REPL evaluates and
+// whenever (watch) is called without a file.
+struct WatchedFile {
+    std::string path;
+    std::string name;                // File name within its directory, as inotify reports it
+    int wd;
+    std::vector<std::string> forms;  // Tokens of each top-level form, joined by spaces
+};
+
+struct Watcher {
+    int fd = -1;
+    std::thread::id owner;
+    EnvironmentPtr env;
+    std::deque<WatchedFile> files;  // Forms being reloaded may watch more files
+    bool reloading = false;
+};
+
+// Never destroyed, like the eval cache
+Watcher& watcher() {
+    static Watcher* w = new Watcher;
+    return *w;
+}
+
+// The tokens of each top-level form, joined by spaces
+std::vector<std::string> topLevelForms(const std::string& text) {
+    FormReader reader;
+    reader.feed(text.data(), text.size());
+    reader.feed("\n", 1);
+    std::vector<std::string> forms, tokens;
+    auto join = [&]() {
+        std::string form;
+        for (auto& t : tokens) form += (form.empty() ? "" : " ") + t;
+        forms.push_back(form);
+    };
+    while (reader.next(tokens)) join();
+    // An unfinished form is kept so that read reports it
+    tokens = reader.tokens;
+    if (reader.inString) tokens.push_back(reader.token);
+    if (!tokens.empty()) join();
+    return forms;
+}
+
+// Sends the global functions that mention one of `names` back to the interpreter
+void resetTiers(const std::set<std::string>& names) {
+    if (names.empty()) return;
+    Watcher& w = watcher();
+    for (auto& binding : w.env->symbols) {
+        const CellPtr& func = binding.second;
+        if (func->type != Lambda || !func->lambda() || func->list().size() < 2) continue;
+        std::set<std::string> used;
+        collectSymbols(func->list()[1], used);
+        bool depends = false;
+        for (auto& n : names) depends = depends || used.count(n);
+        if (!depends) continue;
+
+        retireTiers(*func->lambda());
+    }
+}
+
+size_t reloadWatched(WatchedFile& file) {
+    Watcher& w = watcher();
+    std::ifstream in(file.path);
+    // Replaced by a rename that has not happened yet; its own event follows
+    if (!in) return 0;
+    std::stringstream text;
+    text << in.rdbuf();
+    std::vector<std::string> forms = topLevelForms(text.str());
+
+    std::vector<CellPtr> code(forms.size());
+    std::vector<bool> changed(forms.size());
+    std::multiset<std::string> previous(file.forms.begin(), file.forms.end());
+    std::set<std::string> rebound, macros;
+    for (size_t i = 0; i < forms.size(); i++) {
+        auto it = previous.find(forms[i]);
+        if (it != previous.end()) {
+            previous.erase(it);
+            continue;
+        }
+        changed[i] = true;
+        try {
+            code[i] = read(forms[i]);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << file.path << ": " << e.what() << std::endl;
+            continue;
+        }
+        const CellList& l = code[i]->list();
+        if (l.size() >= 2 && l[0]->type == Symbol && l[1]->type == Symbol &&
+            (l[0]->val() == "define" || l[0]->val() == "defmacro" || l[0]->val() == "set")) {
+            rebound.insert(l[1]->val());
+            if (l[0]->val() == "defmacro") macros.insert(l[1]->val());
+        }
+    }
+    if (!macros.empty()) {
+        for (size_t i = 0; i < forms.size(); i++) {
+            if (changed[i]) continue;
+            for (auto& token : tokenize(forms[i])) {
+                if (macros.count(token)) changed[i] = true;
+            }
+            if (!changed[i]) continue;
+            try {
+                code[i] = read(forms[i]);
+            } catch (const std::exception&) {
+                changed[i] = false;
+            }
+        }
+    }
+    file.forms = forms;
+
+    resetTiers(rebound);
+    clearEvalCache();
+    size_t evaluated = 0;
+    for (size_t i = 0; i < forms.size(); i++) {
+        if (!changed[i] || !code[i]) continue;
+        try {
+            eval(code[i], w.env);
+            evaluated++;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << file.path << ": " << e.what() << std::endl;
+        }
+    }
+    return evaluated;
+}
+
+// Reloads the watched files written since the last poll; the number of forms evaluated
+size_t pollWatches() {
+    Watcher& w = watcher();
+    if (w.fd < 0 || w.reloading || std::this_thread::get_id() != w.owner) return 0;
+    std::vector<bool> written(w.files.size());
+    alignas(struct inotify_event) char buffer[4096];
+    ssize_t n;
+    while ((n = ::read(w.fd, buffer, sizeof buffer)) > 0) {
+        for (char* p = buffer; p < buffer + n;) {
+            auto* event = reinterpret_cast<struct inotify_event*>(p);
+            for (size_t i = 0; i < w.files.size(); i++) {
+                if (event->len && w.files[i].wd == event->wd && w.files[i].name == event->name) written[i] = true;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    struct Reloading {
+        bool& flag;
+        Reloading(bool& flag) : flag(flag) { flag = true; }
+        ~Reloading() { flag = false; }
+    } reloading(w.reloading);
+    size_t evaluated = 0;
+    for (size_t i = 0; i < w.files.size(); i++) {
+        if (written[i]) evaluated += reloadWatched(w.files[i]);
+    }
+    return evaluated;
+}
+
+size_t watchFile(const std::string& path, const EnvironmentPtr& env) {
+    Watcher& w = watcher();
+    if (w.fd < 0) {
+        w.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (w.fd < 0) throw std::runtime_error(std::string("Cannot watch files: ") + std::strerror(errno));
+        w.owner = std::this_thread::get_id();
+        w.env = globalEnvOf(env);
+    } else if (std::this_thread::get_id() != w.owner) {
+        throw std::runtime_error("Files are already watched by another thread");
+    }
+    for (auto& file : w.files) {
+        if (file.path == path) return reloadWatched(file);
+    }
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    // The directory is watched, so editors that save by renaming a new file over the old one are seen too
+    int wd = inotify_add_watch(w.fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) throw std::runtime_error("Cannot watch " + path + ": " + std::strerror(errno));
+    if (!std::ifstream(path)) throw std::runtime_error("Cannot read " + path);
+    w.files.push_back({ path, path.substr(slash == std::string::npos ? 0 : slash + 1), wd, {} });
+    return reloadWatched(w.files.back());
+}
+
+CellPtr procWatch(const Cells& args, const EnvironmentPtr& global) {
+    if (args.size() > 1) throw std::runtime_error("watch takes a file to watch, or nothing to pick up changes now");
+    if (args.empty()) return makeNumber(static_cast<long>(pollWatches()));
+    return makeNumber(static_cast<long>(watchFile(pathArgument(args, 0, "watch"), global)));
+}
+
+/////////////////////////////////////////////////////////////-MODULE CACHE-/////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// (load "file") evaluates every top-level form of a source file in the global
+// Environment. With --module-cache DIR, the forms as read are saved as a fasl in
+// DIR, named by a hash of the file's contents, before any of them runs; a later
+// load of the same contents maps that fasl instead of tokenizing and parsing the
+// text. Macro calls are still expanded as the forms are evaluated, because which
+// names are macros depends on what has been defined by then.
+
+// Set by --module-cache; empty, the default, leaves the cache off
+std::string moduleCacheDir;
+
+// Part of every cached name; bumped whenever read() gives the same text a new meaning.
+// 2: "text" literals read as Strings instead of Symbols
+const int moduleCacheFormat = 2;
+
+// 64-bit FNV-1a of a source file's contents
+std::string sourceHash(const std::string& text) {
+    uint64_t h = 14695981039346656037ull;
+    for (char c : text) h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    char name[40];
+    snprintf(name, sizeof name, "%016llx-%zx", static_cast<unsigned long long>(h), text.size());
+    return name;
+}
+
+// Creates the directory and any missing parents
+bool makeDirectories(const std::string& dir) {
+    for (size_t slash = dir.find('/', 1); ; slash = dir.find('/', slash + 1)) {
+        std::string prefix = dir.substr(0, slash);
+        if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) return false;
+        if (slash == std::string::npos) return true;
+    }
+}
+
+// The top-level forms of the text, from the cache when it has them. A cache
+// that cannot be read or written is passed over; the text is parsed instead.
+std::vector<CellPtr> moduleForms(const std::string& text) {
+    if (moduleCacheDir.empty()) return readAll(text);
+    std::string cached = moduleCacheDir + "/" + sourceHash(text) + "-v" + std::to_string(moduleCacheFormat) + ".fasl";
+    if (access(cached.c_str(), R_OK) == 0) {
+        try {
+            CellPtr forms = readFasl(cached);
+            if (forms->type == List) return std::vector<CellPtr>(forms->list().begin(), forms->list().end());
+        } catch (const std::exception&) {
+            // Rewritten below
+        }
+    }
+    std::vector<CellPtr> forms = readAll(text);
+    auto all = std::make_shared<Cell>(List);
+    for (auto& form : forms) all->mutableList().push_back(form);
+    try {
+        if (makeDirectories(moduleCacheDir)) writeFasl(all, cached);
+    } catch (const std::exception&) {
+        // Loading still works without the cache
+    }
+    return forms;
+}
+
+// The number of forms evaluated
+size_t loadFile(const std::string& path, const EnvironmentPtr& env) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot read " + path);
+    std::stringstream text;
+    text << in.rdbuf();
+    EnvironmentPtr global = globalEnvOf(env);
+    std::vector<CellPtr> forms = moduleForms(text.str());
+    for (auto& form : forms) eval(form, global);
+    return forms.size();
+}
+
+CellPtr procLoad(const Cells& args, const EnvironmentPtr& global) {
+    if (args.size() != 1) throw std::runtime_error("load requires exactly one argument: a source file");
+    return makeNumber(static_cast<long>(loadFile(pathArgument(args, 0, "load"), global)));
+}
+
+///////////////////////////////////////////////////////-EVAL-FX-//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Names eval handles itself when they are not bound to a Proc; their operands
+// are not simply evaluated, so they cannot be called like a function
+bool isSpecialForm(const std::string& name) {
+    static const std::set<std::string> forms = {
+        "quote", "eval", "profile", "delay", "stream-cons", "stream-take", "stream-ref", "go", "with-limits",
+        "set", "if", "cond", "and", "or", "define", "defmacro",
+    };
+    return forms.count(name) > 0;
+}
+
+// Names batch mode runs in input order: they bind global names, touch state the
+// forms share (heap counters, the profiler, channels, stores, files) or run tasks
+const std::set<std::string>& barrierForms() {
+    static const std::set<std::string> forms = {
+        "set", "define", "defmacro", "eval", "profile", "room", "load-native", "go", "chan", "send", "recv", "yield",
+        "store-open", "store-get", "store-put", "store-del", "watch", "load", "write-fasl", "read-fasl",
+    };
+    return forms;
+}
+
+bool isBarrierForm(const std::string& name) {
+    return barrierForms().count(name) > 0;
+}
+
+bool mentionsBarrierForm(const CellPtr& expr) {
+    checkStack();
+    if (expr->type == Symbol) return isBarrierForm(expr->val());
+    for (auto& e : expr->list()) {
+        if (mentionsBarrierForm(e)) return true;
+    }
+    return false;
+}
+
+CellPtr eval(CellPtr expr, EnvironmentPtr env) {
+    checkStack();
+    if (evalLimits.active) chargeStep();
+
+    // If it's a number, return it directly
+    if (expr->type == Number) return expr;
+
+    // Strings and promises evaluate to themselves; a rope's parts are not code
+    if (expr->type == String || expr->type == Promise) return expr;
+
+    // Lookup symbols in the environment
+    if (expr->type == Symbol) return env->find(expr->val());
+
+    // Return empty lists as-is
+    if (expr->list().empty()) return expr;
+
+    CellPtr first = expr->list()[0]; // First element in the list (function or special form)
+
+    // Handle global operators 
+    if (first->type == Symbol) {
+        CellPtr proc = env->lookup(first->val());
+
+        if (proc && proc->type == Proc) {
+            if (isPipeline(expr, proc, env)) {
+                if (profilingEnabled) {
+                    ProfileScope scope(first->val());
+                    return evalPipeline(expr, proc, env);
+                }
+                return evalPipeline(expr, proc, env);
+            }
+            Cells args;
+            for (size_t i = 1; i < expr->list().size(); i++) {
+                args.push_back(eval(expr->list()[i], env));
+            }
+            // Call the procedure
+            if (profilingEnabled) {
+                ProfileScope scope(first->val());
+                return proc->proc()(args);
+            }
+            return proc->proc()(args);
+        }
+    }
+
+    // QUOTE
+    if (first->type == Symbol && first->val() == "quote") {
+        return expr->list()[1]; 
+    }
+
+    // EVAL
+    if (first->type == Symbol && first->val() == "eval") {
+        return evalForm(eval(expr->list()[1], env), env); 
+    }
+
+    // PROFILE
+    if (first->type == Symbol && first->val() == "profile") {
+        if (expr->list().size() != 2) {
+            throw std::runtime_error("profile requires exactly one argument");
+        }
+        // Profile this expression on its own, then fold it back into any running profile
+        bool wasEnabled = profilingEnabled;
+        ProfileTable outer;
+        std::swap(outer, threadProfile.table);
+        profilingEnabled = true;
+        CellPtr result;
+        try {
+            result = eval(expr->list()[1], env);
+        } catch (...) {
+            profilingEnabled = wasEnabled;
+            mergeProfile(outer, threadProfile.table);
+            std::swap(outer, threadProfile.table);
+            throw;
+        }
+        profilingEnabled = wasEnabled;
+        std::cout.flush();
+        profileReport(std::cerr, threadProfile.table);
+        mergeProfile(outer, threadProfile.table);
+        std::swap(outer, threadProfile.table);
+        return result;
+    }
+
+    // DELAY and STREAM-CONS
+    if (first->type == Symbol && first->val() == "delay") {
+        if (expr->list().size() != 2) {
+            throw std::runtime_error("delay requires exactly one expression");
+        }
+        return makePromise(expr->list()[1], env);
+    }
+    if (first->type == Symbol && first->val() == "stream-cons") {
+        if (expr->list().size() != 3) {
+            throw std::runtime_error("stream-cons requires an element and an expression for the rest");
+        }
+        auto pair = std::make_shared<Cell>(List);
+        pair->mutableList().push_back(eval(expr->list()[1], env));
+        pair->mutableList().push_back(makePromise(expr->list()[2], env));
+        return pair;
+    }
+
+    // STREAM-TAKE and STREAM-REF
+    if (first->type == Symbol && (first->val() == "stream-take" || first->val() == "stream-ref")) {
+        if (expr->list().size() != 3) {
+            throw std::runtime_error(first->val() + " requires a stream and a count");
+        }
+        CellPtr stream = eval(expr->list()[1], env);
+        CellPtr count = eval(expr->list()[2], env);
+        if (count->type != Number || numberValue(count) < 0) {
+            throw std::runtime_error(first->val() + " requires a stream and a count");
+        }
+        if (first->val() == "stream-take") return streamTake(std::move(stream), numberValue(count));
+        return streamRef(std::move(stream), numberValue(count));
+    }
+
+    // GO
+    if (first->type == Symbol && first->val() == "go") {
+        if (expr->list().size() != 2) {
+            throw std::runtime_error("go requires exactly one expression");
+        }
+        return spawnTask(expr->list()[1], env);
+    }
+
+    // WITH-LIMITS
+    if (first->type == Symbol && first->val() == "with-limits") {
+        if (expr->list().size() < 2) {
+            throw std::runtime_error("with-limits requires a body: (with-limits (steps N) (memory BYTES) (time MS) expr)");
+        }
+        long steps = 0, memory = 0, timeMs = 0;
+        for (size_t i = 1; i + 1 < expr->list().size(); i++) {
+            const CellPtr& clause = expr->list()[i];
+            if (clause->type != List || clause->list().size() != 2 || clause->list()[0]->type != Symbol) {
+                throw std::runtime_error("with-limits clauses look like (steps N), (memory BYTES) or (time MS)");
+            }
+            CellPtr value = eval(clause->list()[1], env);
+            if (value->type != Number || numberValue(value) <= 0) {
+                throw std::runtime_error("with-limits: " + clause->list()[0]->val() + " must be a positive number");
+            }
+            const std::string& name = clause->list()[0]->val();
+            if (name == "steps") steps = numberValue(value);
+            else if (name == "memory") memory = numberValue(value);
+            else if (name == "time") timeMs = numberValue(value);
+            else throw std::runtime_error("with-limits: unknown limit " + name);
+        }
+        LimitScope scope(steps, memory, timeMs);
+        return eval(expr->list().back(), env);
+    }
+
+    // SET
+    if (first->type == Symbol && first->val() == "set") {
+        if (expr->list().size() != 3) {
+            throw std::runtime_error("set requires exactly two arguments: a name and a value");
+        }
+        std::string var = expr->list()[1]->val(); 
+        if (expr->list()[1]->type != Symbol) {
+            throw std::runtime_error("First argument of set must be a symbol");
+        }
+        CellPtr val = eval(expr->list()[2], env); 
+        env->define(var, val);                  
+        if (!env->outer) bindingChanged(var);
+        return val;
+    }
+
+    // IF
+    if (first->type == Symbol && first->val() == "if") {
+        if (expr->list().size() < 3) {
+            throw std::runtime_error("if requires at least three arguments");
+        }
+        CellPtr condition = eval(expr->list()[1], env); 
+        if (isTrue(condition)) {
+            return eval(expr->list()[2], env);          
+        } else if (expr->list().size() > 3) {
+            return eval(expr->list()[3], env);         
+        }
+        return std::make_shared<Cell>(Symbol, "nil"); 
+    }
+
+    // COND
+    if (first->type == Symbol && first->val() == "cond") {
+        for (size_t i = 1; i < expr->list().size(); ++i) {
+            CellPtr clause = expr->list()[i];
+            if (clause->type != List || clause->list().size() != 2) {
+                throw std::runtime_error("Each cond clause must have exactly two elements");
+            }
+            CellPtr condition = eval(clause->list()[0], env); 
+            if (isTrue(condition)) {
+                return eval(clause->list()[1], env); 
+            }
+        }
+        return std::make_shared<Cell>(Symbol, "nil"); 
+    }
+
+    // AND
+    if (first->type == Symbol && first->val() == "and") {
+        CellPtr e1 = eval(expr->list()[1], env); 
+        if (!isTrue(e1)) return std::make_shared<Cell>(Symbol, "nil"); 
+        return eval(expr->list()[2], env); 
+    }
+
+    // OR
+    if (first->type == Symbol && first->val() == "or") {
+        CellPtr e1 = eval(expr->list()[1], env); 
+        if (isTrue(e1)) return std::make_shared<Cell>(Symbol, "t"); 
+        return eval(expr->list()[2], env); 
+    }
+
+    // Handle built-in list functions
+    if (first->type == Symbol) {
+        std::string funcName = first->val();
+
+        if (funcName == "and?") return applyPrimitive(funcName, procAnd, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
+        if (funcName == "or?") return applyPrimitive(funcName, procOr, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
+        if (funcName == "number?") return applyPrimitive(funcName, procNumber, { eval(expr->list()[1], env) });
+        if (funcName == "symbol?") return applyPrimitive(funcName, procSymbol, { eval(expr->list()[1], env) });
+        if (funcName == "list?") return applyPrimitive(funcName, procList, { eval(expr->list()[1], env) });
+        if (funcName == "nil?") return applyPrimitive(funcName, procNil, { eval(expr->list()[1], env) });
+
+        if (funcName == "not") return applyPrimitive(funcName, procNot, { eval(expr->list()[1], env) });
+        if (funcName == "atom") return applyPrimitive(funcName, procAtom, { eval(expr->list()[1], env) });
+
+
+        // Built-in list manipulation
+        if (funcName == "car") {
+            if (expr->list().size() != 2) {
+                throw std::runtime_error("car requires exactly one argument");
+            }
+            return applyPrimitive(funcName, procCar, { eval(expr->list()[1], env) });
+        }
 
         if (funcName == "cdr") {
-            if (expr->list.size() != 2) {
+            if (expr->list().size() != 2) {
                 throw std::runtime_error("cdr requires exactly one argument");
             }
-            CellPtr arg = eval(expr->list[1], env);
-            if (arg->type != List || arg->list.empty()) {
-                throw std::runtime_error("cdr requires a non-empty list");
-            }
-            CellPtr result = std::make_shared<Cell>(List);
-            result->list.insert(result->list.end(), arg->list.begin() + 1, arg->list.end());
-            return result;
+            return applyPrimitive(funcName, procCdr, { eval(expr->list()[1], env) });
         }
 
         if (funcName == "cons") {
-            if (expr->list.size() != 3) {
+            if (expr->list().size() != 3) {
                 throw std::runtime_error("cons requires exactly two arguments");
             }
-            CellPtr head = eval(expr->list[1], env);
-            CellPtr tail = eval(expr->list[2], env);
-            CellPtr result = std::make_shared<Cell>(List);
-            result->list.push_back(head);
-            if (tail->type == List) {
-                result->list.insert(result->list.end(), tail->list.begin(), tail->list.end());
-            } else if (tail->type == Symbol && tail->val == "nil") {
-                // Do nothing
-            } else {
-                throw std::runtime_error("cons requires the second argument to be a list or nil");
-            }
-            return result;
+            return applyPrimitive(funcName, procCons, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
         }
     }
 
     // Arithmetic, comparison, and other built-in operators
     if (first->type == Symbol) {
-        std::string funcName = first->val;
+        std::string funcName = first->val();
 
         // Arithmetic operators
-        if (funcName == "add") return procAdd({ eval(expr->list[1], env), eval(expr->list[2], env) });
-        if (funcName == "sub") return procSub({ eval(expr->list[1], env), eval(expr->list[2], env) });
-        if (funcName == "mul") return procMul({ eval(expr->list[1], env), eval(expr->list[2], env) });
-        if (funcName == "div") return procDiv({ eval(expr->list[1], env), eval(expr->list[2], env) });
-        if (funcName == "mod") return procMod({ eval(expr->list[1], env), eval(expr->list[2], env) });
+        if (funcName == "add") return applyPrimitive(funcName, procAdd, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
+        if (funcName == "sub") return applyPrimitive(funcName, procSub, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
+        if (funcName == "mul") return applyPrimitive(funcName, procMul, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
+        if (funcName == "div") return applyPrimitive(funcName, procDiv, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
+        if (funcName == "mod") return applyPrimitive(funcName, procMod, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
 
         // Comparison operators
-        if (funcName == "eq") return procEquals({ eval(expr->list[1], env), eval(expr->list[2], env) });
-        if (funcName == "lt") return procLessThan({ eval(expr->list[1], env), eval(expr->list[2], env) });
-        if (funcName == "gt") return procGreaterThan({ eval(expr->list[1], env), eval(expr->list[2], env) });
-        if (funcName == "lte") return procLessEqual({ eval(expr->list[1], env), eval(expr->list[2], env) });
-        if (funcName == "gte") return procGreaterEqual({ eval(expr->list[1], env), eval(expr->list[2], env) });
+        if (funcName == "eq") return applyPrimitive(funcName, procEquals, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
+        if (funcName == "lt") return applyPrimitive(funcName, procLessThan, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
+        if (funcName == "gt") return applyPrimitive(funcName, procGreaterThan, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
+        if (funcName == "lte") return applyPrimitive(funcName, procLessEqual, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
+        if (funcName == "gte") return applyPrimitive(funcName, procGreaterEqual, { eval(expr->list()[1], env), eval(expr->list()[2], env) });
 
         // Define user-defined functions
         if (funcName == "define") {
-            if (expr->list.size() != 4) {
+            if (expr->list().size() != 4) {
                 throw std::runtime_error("define requires three arguments: name, args, body");
             }
-            std::string funcName = expr->list[1]->val;
-            CellPtr args = expr->list[2];
-            CellPtr body = expr->list[3];
-            auto lambda = std::make_shared<Cell>(Lambda);
-            lambda->list.push_back(args);
-            lambda->list.push_back(body);
-            lambda->env = env; 
+            if (expr->list()[1]->type != Symbol) {
+                throw std::runtime_error("First argument of define must be a symbol");
+            }
+            if (expr->list()[2]->type != List) {
+                throw std::runtime_error("Second argument of define must be a parameter list");
+            }
+            std::string funcName = expr->list()[1]->val();
+            CellPtr args = expr->list()[2];
+            CellPtr body = expr->list()[3];
+            // The define form may be data the program built and still holds
+            if (hasMacroCalls(body, env)) body = copyCode(body);
+            std::set<std::string> params = { funcName };
+            for (auto& p : args->list()) {
+                if (p->type != Symbol) throw std::runtime_error("Parameters of define must be symbols");
+                params.insert(p->val());
+            }
+            expandMacros(body, env, params);
+            auto lambda = std::make_shared<Cell>(Lambda, funcName);  // Keep the name for the profiler
+            lambda->mutableList().push_back(args);
+            lambda->mutableList().push_back(body);
+            lambda->mutableLambda().reset(new LambdaData());
+            lambda->mutableLambda()->usesBarrier = mentionsBarrierForm(body);
+            lambda->mutableEnv() = captureEnvironment(args, body, funcName, env, lambda->lambda()->flatClosure);
+            if (lambda->env()->outer && !lambda->env()->captured) {
+                // A frame it sees may still be bound again by a local set or define, which
+                // bindingChanged does not hear of, so the tiers cannot resolve names ahead
+                lambda->lambda()->jitState.store(TierRejected, std::memory_order_relaxed);
+                lambda->lambda()->specState.store(TierRejected, std::memory_order_relaxed);
+            }
             env->define(funcName, lambda);
+            if (!env->outer) bindingChanged(funcName);
             return std::make_shared<Cell>(Symbol, funcName); 
         }
 
+        // Define macros
+        if (funcName == "defmacro") {
+            if (expr->list().size() != 4 || expr->list()[1]->type != Symbol || expr->list()[2]->type != List) {
+                throw std::runtime_error("defmacro requires three arguments: name, args, body");
+            }
+            std::string name = expr->list()[1]->val();
+            auto macro = std::make_shared<Cell>(Macro, name);
+            macro->mutableList().push_back(expr->list()[2]);
+            macro->mutableList().push_back(expr->list()[3]);
+            macro->mutableEnv() = env;
+            env->define(name, macro);
+            if (!env->outer) bindingChanged(name);
+            return std::make_shared<Cell>(Symbol, name);
+        }
+
         // User-defined functions
         CellPtr func = env->find(funcName);
+        if (func->type == Macro) return eval(expansionOf(expr, func), env);
         if (func->type == Lambda) {
-            if (func->list.size() < 2) {
+            if (func->list().size() < 2) {
                 throw std::runtime_error("Malformed function definition");
             }
 
-            CellPtr args = func->list[0];
-            CellPtr body = func->list[1];
+            CellPtr args = func->list()[0];
+            CellPtr body = func->list()[1];
 
-            if (args->list.size() != expr->list.size() - 1) {
+            if (args->list().size() != expr->list().size() - 1) {
                 throw std::runtime_error("Argument count mismatch");
             }
 
+            // Lambdas called by their own name go through the execution tiers
+            if (func->lambda() && !profilingEnabled && funcName == func->val()) {
+                Cells argv;
+                for (size_t i = 1; i < expr->list().size(); i++) argv.push_back(eval(expr->list()[i], env));
+                return callTiered(func, argv);
+            }
+
             // Create a new environment for the function call
-            EnvironmentPtr localEnv = std::make_shared<Environment>(func->env);
-            for (size_t i = 0; i < args->list.size(); ++i) {
-                localEnv->define(args->list[i]->val, eval(expr->list[i + 1], env));
+            EnvironmentPtr localEnv = callFrame(func);
+            for (size_t i = 0; i < args->list().size(); ++i) {
+                localEnv->define(args->list()[i]->val(), eval(expr->list()[i + 1], env));
             }
 
             // Evaluate the function body in the new environment
+            if (profilingEnabled) {
+                ProfileScope scope(func->val().empty() ? "<lambda>" : func->val());
+                return eval(body, localEnv);
+            }
             return eval(body, localEnv);
         }
     }
@@ -696,32 +4516,308 @@ CellPtr eval(CellPtr expr, EnvironmentPtr env) {
 
 //////////////////////////////////////////////////////////////PRINT-FX-///////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-std::string toString(CellPtr exp) {
-    if (exp->type == Number || exp->type == Symbol) return exp->val;
-    if (exp->type == List) {
-        std::string s = "(";
-        for (auto& e : exp->list) s += toString(e) + " ";
-        s.pop_back();
-        return s + ")";
+// Appends straight to an output buffer and walks lists with an explicit stack,
+// so deeply nested or very long data prints in linear time, without recursion
+// or a temporary string per element. Lists nested deeper than printDepth print
+// as "#", elements past printLength as "..."; 0 means no limit. A list that
+// contains itself, which only code rewritten in place could produce, prints as
+// "<cycle>" where it recurs.
+size_t printDepth = 0;
+size_t printLength = 0;
+const size_t cycleCheckDepth = 1024;  // Shallower lists cannot be cycles worth looking for yet
+
+void printAtom(const Cell* c, std::string& out) {
+    if (c->type == Number) {
+        char digits[24];
+        out.append(digits, std::snprintf(digits, sizeof(digits), "%ld", c->number));
+    }
+    else if (c->type == Symbol || c->type == Chan || c->type == Store || c->type == Promise) out += c->val();
+    else if (c->type == String) {
+        out += '"';
+        appendText(c, 0, stringLength(c), out);
+        out += '"';
+    }
+    else if (c->type == Lambda) out += "<Lambda>";
+    else if (c->type == Macro) out += "<Macro>";
+    else out += "<Proc>";
+}
+
+void print(const CellPtr& exp, std::string& out) {
+    struct Open {
+        const Cell* list;
+        size_t next;
+    };
+    std::vector<Open> open;
+    std::unordered_set<const Cell*> onPath;  // The open lists, once nesting passes cycleCheckDepth
+    const Cell* c = exp.get();
+    while (c) {
+        if (c->type != List) {
+            printAtom(c, out);
+        } else if (printDepth && open.size() >= printDepth) {
+            out += '#';
+        } else {
+            bool cycle = false;
+            if (open.size() >= cycleCheckDepth) {
+                if (onPath.empty()) {
+                    for (auto& o : open) onPath.insert(o.list);
+                }
+                cycle = !onPath.insert(c).second;
+            }
+            if (cycle) {
+                out += "<cycle>";
+            } else {
+                out += '(';
+                open.push_back({ c, 0 });
+            }
+        }
+
+        c = nullptr;
+        while (!open.empty() && !c) {
+            Open& top = open.back();
+            size_t size = top.list->list().size();
+            if (top.next < size && printLength && top.next >= printLength) {
+                out += " ...";
+                top.next = size;
+            }
+            if (top.next < size) {
+                if (top.next > 0) out += ' ';
+                c = top.list->list()[top.next++].get();
+                continue;
+            }
+            out += ')';
+            if (!onPath.empty()) onPath.erase(top.list);
+            open.pop_back();
+        }
     }
-    if (exp->type == Lambda) return "<Lambda>";
-    return "<Proc>";
+}
+
+std::string toString(CellPtr exp) {
+    std::string s;
+    print(exp, s);
+    return s;
 }
 //////////////////////////////////////////////////////////////REPL-LOOP///////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Evaluates one form typed at the top level under the session limits, if any,
+// and then lets the green threads it started run
+CellPtr evalTopLevel(const CellPtr& form, EnvironmentPtr env) {
+    CellPtr result;
+    if (!sessionMaxSteps && !sessionMaxMemory && !sessionTimeoutMs) {
+        result = eval(form, env);
+    } else {
+        LimitScope scope(sessionMaxSteps, sessionMaxMemory, sessionTimeoutMs);
+        result = eval(form, env);
+    }
+    runGreenThreads();
+    return result;
+}
+
+// When stdin is not a terminal nobody is waiting at the prompt: std::cin stops
+// flushing std::cout before every read and both get large buffers, so a
+// pipeline costs one system call per 64KB instead of per line. std::cerr stays
+// tied to std::cout, which keeps errors in order with the results before them.
+// Must run before any input or output.
+const size_t pipeBufferBytes = 64 << 10;
+
+void useBufferedIO() {
+    static char input[pipeBufferBytes];
+    static char output[pipeBufferBytes];
+    std::ios::sync_with_stdio(false);
+    std::cin.rdbuf()->pubsetbuf(input, sizeof input);
+    std::cout.rdbuf()->pubsetbuf(output, sizeof output);
+    std::cin.tie(nullptr);
+}
+
+// Evaluates every form as soon as the line that completes it is read; the
+// prompt is shown only when no form is left open
 void repl(const std::string& prompt, EnvironmentPtr env) {
+    FormReader reader;
+    std::string line;
+    std::vector<std::string> tokens;
+    std::string output;  // Reused for every result
     while (true) {
-        std::cout << prompt;
-        std::string line;
+        if (!reader.pending()) std::cout << prompt;
         if (!std::getline(std::cin, line)) break;
-        if (line.empty()) continue;
-        try {
-            CellPtr result = eval(read(line), env);
-            std::cout << toString(result) << std::endl;
-        } catch (const std::exception& e) {
-            std::cerr << "Error: " << e.what() << std::endl;
+        reader.feedLine(line);
+        if (!reader.complete.empty()) pollWatches();
+        while (reader.next(tokens)) {
+            try {
+                CellPtr result = evalTopLevel(readFromTokens(tokens), env);
+                output.clear();
+                print(result, output);
+                output += '\n';
+                // No flush: an interactive read flushes std::cout through the tie of std::cin, an error through std::cerr's
+                std::cout << output;
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+        }
+    }
+    if (reader.pending()) std::cerr << "Error: Unexpected EOF" << std::endl;
+}
+
+/////////////////////////////////////////////////////////////-BATCH-MODE-/////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Result of evaluating one form, kept so it can be printed later in input order
+struct LineResult {
+    bool ok = true;
+    std::string text;
+};
+
+// One form read ahead of evaluation; form stays null if it failed to parse
+struct BatchLine {
+    CellPtr form;
+    LineResult result;
+    size_t prompts = 0;  // Prompts repl() would have shown since the previous form
+};
+
+void evalBatchLine(BatchLine& line, EnvironmentPtr env) {
+    if (!line.form) return;
+    try {
+        line.result.text = toString(evalTopLevel(line.form, env));
+    } catch (const std::exception& e) {
+        line.result.ok = false;
+        line.result.text = e.what();
+    }
+}
+
+// A form is a barrier if it uses a barrier form, directly or through the global
+// functions, macros and promises it names; it has to run after everything before
+// it and before everything after it. Names are looked up when the form is about
+// to run, so functions defined by the barriers before it are followed.
+bool isBarrier(const CellPtr& expr, const EnvironmentPtr& env, std::unordered_set<const Cell*>& seen);
+
+bool isBarrierValue(const CellPtr& value, const EnvironmentPtr& env, std::unordered_set<const Cell*>& seen) {
+    switch (value->type) {
+    case Proc:
+        // Primitives have no name of their own; this one may be bound to another
+        for (auto& name : barrierForms()) {
+            if (env->lookup(name) == value) return true;
+        }
+        return false;
+    case Lambda:
+        if (!seen.insert(value.get()).second) return false;
+        return value->lambda()->usesBarrier || isBarrier(value->list()[1], env, seen);
+    case Macro:
+        if (!seen.insert(value.get()).second) return false;
+        return isBarrier(value->list()[1], env, seen);
+    case Promise:
+        // What a native promise calls cannot be seen
+        if (value->proc()) return true;
+        return isBarrier(value->list()[0], env, seen);
+    case List:
+        if (!seen.insert(value.get()).second) return false;
+        for (auto& e : value->list()) {
+            if (isBarrierValue(e, env, seen)) return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+bool isBarrier(const CellPtr& expr, const EnvironmentPtr& env, std::unordered_set<const Cell*>& seen) {
+    checkStack();
+    if (expr->type == Symbol) {
+        if (isBarrierForm(expr->val())) return true;
+        CellPtr value = env->lookup(expr->val());
+        return value && isBarrierValue(value, env, seen);
+    }
+    if (expr->type == List) {
+        for (auto& e : expr->list()) {
+            if (isBarrier(e, env, seen)) return true;
+        }
+    }
+    return false;
+}
+
+// A form that failed to parse is not run at all
+bool isBarrier(const CellPtr& form, const EnvironmentPtr& env) {
+    if (!form) return false;
+    std::unordered_set<const Cell*> seen;
+    return isBarrier(form, env, seen);
+}
+
+// Print results exactly like repl() would have
+void printResults(const std::string& prompt, const std::vector<BatchLine>& parsed, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        for (size_t p = 0; p < parsed[i].prompts; p++) std::cout << prompt;
+        const LineResult& r = parsed[i].result;
+        if (r.ok) {
+            std::cout << r.text << '\n';
+        } else {
+            std::cout.flush();
+            std::cerr << "Error: " << r.text << std::endl;
+        }
+    }
+    std::cout.flush();
+}
+
+// Reads every form from stdin, evaluates runs of independent forms on `jobs` threads
+// and treats barriers (see isBarrier) as ordered
+void batch(const std::string& prompt, EnvironmentPtr env, unsigned jobs) {
+    FormReader reader;
+    std::string line;
+    std::vector<std::string> tokens;
+    std::vector<BatchLine> parsed;
+    size_t prompts = 0;
+    while (true) {
+        if (!reader.pending()) prompts++;
+        if (!std::getline(std::cin, line)) break;
+        reader.feedLine(line);
+        while (reader.next(tokens)) {
+            BatchLine form;
+            form.prompts = prompts;
+            prompts = 0;
+            try {
+                form.form = readFromTokens(tokens);
+            } catch (const std::exception& e) {
+                form.result.ok = false;
+                form.result.text = e.what();
+            }
+            parsed.push_back(std::move(form));
+        }
+    }
+
+    size_t i = 0;
+    bool atBarrier = !parsed.empty() && isBarrier(parsed[0].form, env);
+    while (i < parsed.size()) {
+        if (atBarrier) {
+            evalBatchLine(parsed[i], env);
+            printResults(prompt, parsed, i, i + 1);
+            i++;
+            atBarrier = i < parsed.size() && isBarrier(parsed[i].form, env);
+            continue;
+        }
+
+        // Collect the run of independent forms up to the next barrier; none of them
+        // changes the global bindings, so all are checked against the same functions
+        size_t end = i + 1;
+        while (end < parsed.size() && !(atBarrier = isBarrier(parsed[end].form, env))) end++;
+
+        unsigned workers = static_cast<unsigned>(std::min<size_t>(jobs, end - i));
+        if (workers <= 1) {
+            for (size_t k = i; k < end; k++) evalBatchLine(parsed[k], env);
+        } else {
+            std::atomic<size_t> next(i);
+            std::vector<std::thread> pool;
+            bool profiling = profilingEnabled;
+            for (unsigned w = 0; w < workers; w++) {
+                pool.emplace_back([&]() {
+                    profilingEnabled = profiling;
+                    runOnEvalStack([&]() {
+                        for (size_t k = next++; k < end; k = next++) evalBatchLine(parsed[k], env);
+                    });
+                });
+            }
+            for (auto& t : pool) t.join();
         }
+        printResults(prompt, parsed, i, end);
+        i = end;
     }
+    for (size_t p = 0; p < prompts; p++) std::cout << prompt;
+    std::cout.flush();
+    if (reader.pending()) std::cerr << "Error: Unexpected EOF" << std::endl;
 }
 
 //////////////////////////////////////////////////-TESTING-///////////////////////////////////////////////////////////////////////////
@@ -729,8 +4825,85 @@ void repl(const std::string& prompt, EnvironmentPtr env) {
 
 //Insert Tests here 
 
-int main() {
+// Tools that include this file (benchmarks, compiler) provide their own main()
+#ifndef YISP_NO_MAIN
+[[noreturn]] void usageError(const std::string& problem) {
+    std::cerr << "lisp: " << problem << "\n"
+              << "usage: lisp [--batch [-j N]] [--quiet] [--profile] [--heap-stats] [--no-jit] [--no-specialize]\n"
+              << "            [--jit-threshold N] [--max-steps N] [--max-memory-mb N] [--timeout-ms N]\n"
+              << "            [--stack-mb N] [--task-stack-kb N] [--print-depth N] [--print-length N]\n"
+              << "            [--module-cache DIR] [--no-module-cache]" << std::endl;
+    std::exit(2);
+}
+
+// The value given to a numeric flag, raised to `minimum`; `text` is null when the flag
+// was last on the command line. Anything but a whole number up to `maximum` is a usage error.
+long flagValue(const std::string& flag, const char* text, long minimum, long maximum = LONG_MAX) {
+    if (!text) usageError(flag + " requires a value");
+    errno = 0;
+    char* end = nullptr;
+    long value = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0') usageError(flag + " expects a whole number, got '" + text + "'");
+    if (errno == ERANGE || value > maximum) usageError(flag + " value " + text + " is too large");
+    return std::max(minimum, value);
+}
+
+int main(int argc, char* argv[]) {
     auto global_env = createGlobalEnv();
+    bool batchMode = false;
+    bool profileAtExit = false;
+    bool heapStatsAtExit = false;
+    bool quiet = false;
+    unsigned jobs = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--batch") {
+            batchMode = true;
+        } else if (arg == "--profile") {
+            profileAtExit = true;
+        } else if (arg == "--heap-stats") {
+            heapStatsAtExit = true;
+        } else if (arg == "--quiet") {
+            quiet = true;
+        } else if (arg == "--no-jit") {
+            jitEnabled = false;
+        } else if (arg == "--no-specialize") {
+            specializeEnabled = false;
+        } else if (arg == "--max-steps") {
+            sessionMaxSteps = flagValue(arg, i + 1 < argc ? argv[++i] : nullptr, 0);
+        } else if (arg == "--max-memory-mb") {
+            sessionMaxMemory = flagValue(arg, i + 1 < argc ? argv[++i] : nullptr, 0, LONG_MAX >> 20) << 20;
+        } else if (arg == "--timeout-ms") {
+            // Deadlines are kept in nanoseconds from now; half the range leaves room for the clock
+            sessionTimeoutMs = flagValue(arg, i + 1 < argc ? argv[++i] : nullptr, 0, LONG_MAX / 2000000);
+        } else if (arg == "--task-stack-kb") {
+            taskStackBytes = static_cast<size_t>(flagValue(arg, i + 1 < argc ? argv[++i] : nullptr, 256, LONG_MAX >> 10)) << 10;
+        } else if (arg == "--stack-mb") {
+            evalStackBytes = static_cast<size_t>(flagValue(arg, i + 1 < argc ? argv[++i] : nullptr, 1, LONG_MAX >> 20)) << 20;
+        } else if (arg == "--jit-threshold") {
+            jitThreshold = flagValue(arg, i + 1 < argc ? argv[++i] : nullptr, 1);
+        } else if (arg == "--print-depth") {
+            printDepth = static_cast<size_t>(flagValue(arg, i + 1 < argc ? argv[++i] : nullptr, 0));
+        } else if (arg == "--print-length") {
+            printLength = static_cast<size_t>(flagValue(arg, i + 1 < argc ? argv[++i] : nullptr, 0));
+        } else if (arg == "--module-cache") {
+            if (i + 1 >= argc) usageError(arg + " requires a directory");
+            moduleCacheDir = argv[++i];
+        } else if (arg == "--no-module-cache") {
+            moduleCacheDir.clear();
+        } else if (arg == "-j") {
+            jobs = static_cast<unsigned>(flagValue(arg, i + 1 < argc ? argv[++i] : nullptr, 1, UINT_MAX));
+        } else if (arg.rfind("-j", 0) == 0 && arg.size() > 2) {
+            jobs = static_cast<unsigned>(flagValue("-j", arg.c_str() + 2, 1, UINT_MAX));
+        } else {
+            usageError("unknown option '" + arg + "'");
+        }
+    }
+    if (jobs == 0) jobs = 1;
+    profilingEnabled = profileAtExit;
+    if (!isatty(STDIN_FILENO)) useBufferedIO();
+    const std::string prompt = quiet ? "" : "lisp> ";
+
     //std::cout << "Sprint 1 Tests:" << std::endl;
     //testSprint1();
 
@@ -749,6 +4922,27 @@ int main() {
     //std::cout << "\nSprint 6 Tests:" << std::endl;
     //testSprint6();
 
-    repl("lisp> ", global_env);
+    runOnEvalStack([&]() {
+        if (batchMode) {
+            batch(prompt, global_env, jobs);
+        } else {
+            repl(prompt, global_env);
+        }
+    });
+
+    if (profileAtExit) {
+        ProfileTable total = threadProfile.table;
+        {
+            std::lock_guard<std::mutex> lock(profileMutex);
+            mergeProfile(total, retiredProfile);
+        }
+        std::cout.flush();
+        profileReport(std::cerr, total);
+    }
+    if (heapStatsAtExit) {
+        std::cout.flush();
+        heapReport(std::cerr, heapSnapshot());
+    }
     return 0;
 }
+#endif
@@ -0,0 +1,61 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint10()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+// Opens the store at `path` in a fresh environment, runs `code` and closes it again
+std::string withStore(const std::string& path, const std::string& code) {
+    EnvironmentPtr env = createGlobalEnv();
+    eval(read("(set db (store-open \"" + path + "\"))"), env);
+    std::string result = toString(eval(read(code), env));
+    eval(read("(set db nil)"), env);
+    return result;
+}
+
+off_t fileSize(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+void testSprint10() {
+    std::string path = "/tmp/yisp_sprint10_" + std::to_string(getpid()) + ".db";
+    unlink(path.c_str());
+    try {
+        // Test 1: values written before the store was closed are there after reopening
+        withStore(path, "(store-put db 'a '(1 (x y)))");
+        withStore(path, "(store-put db 'b 2)");
+        std::string result1 = withStore(path, "(cons (store-get db 'a) (cons (store-get db 'b) nil))");
+        std::cout << "Test 1 - reopen: " << result1 << " - "
+                  << (result1 == "((1 (x y)) 2)" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: a log cut inside its last record loses that record only
+        off_t size = fileSize(path);
+        if (truncate(path.c_str(), size - 3) != 0) throw std::runtime_error("cannot truncate " + path);
+        std::string result2 = withStore(path, "(cons (store-get db 'a) (cons (store-get db 'b) nil))");
+        std::cout << "Test 2 - reopen after a torn write: " << result2 << " - "
+                  << (result2 == "((1 (x y)) nil)" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: records written after the torn one are kept
+        withStore(path, "(store-put db 'c 3)");
+        std::string result3 = withStore(path, "(store-get db 'c)");
+        std::cout << "Test 3 - write after a torn record: " << result3 << " - "
+                  << (result3 == "3" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: overwriting one key past the compaction threshold rewrites the file
+        EnvironmentPtr env = createGlobalEnv();
+        eval(read("(set db (store-open \"" + path + "\"))"), env);
+        CellPtr put = read("(store-put db 'big \"" + std::string(4000, 'x') + "\")");
+        for (int i = 0; i < 600; i++) eval(put, env);
+        eval(read("(store-put db 'big 42)"), env);
+        eval(read("(set db nil)"), env);
+        std::string result4 = withStore(path, "(store-get db 'big)") + " " + withStore(path, "(store-get db 'c)");
+        off_t compacted = fileSize(path);
+        std::cout << "Test 4 - compaction: " << result4 << ", " << compacted << " bytes - "
+                  << (result4 == "42 3" && compacted < (1 << 20) ? "PASS" : "FAIL") << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 10 tests: " << e.what() << std::endl;
+    }
+    unlink(path.c_str());
+}
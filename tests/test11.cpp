@@ -0,0 +1,114 @@
+#include "lisp.cpp"
+
+#include <dirent.h>
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint11()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+void writeText(const std::string& path, const std::string& text) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << text;
+}
+
+// The files in dir; with `remove`, they are deleted together with dir
+size_t filesIn(const std::string& dir, bool remove = false) {
+    size_t n = 0;
+    if (DIR* d = opendir(dir.c_str())) {
+        while (struct dirent* e = readdir(d)) {
+            if (e->d_name[0] == '.') continue;
+            n++;
+            if (remove) unlink((dir + "/" + e->d_name).c_str());
+        }
+        closedir(d);
+    }
+    if (remove) rmdir(dir.c_str());
+    return n;
+}
+
+void testSprint11() {
+    std::string dir = "/tmp/yisp_sprint11_" + std::to_string(getpid());
+    std::string cacheDir = dir + "/cache";
+    std::string saved = moduleCacheDir;
+    mkdir(dir.c_str(), 0755);
+    try {
+        EnvironmentPtr env = createGlobalEnv();
+
+        // Test 1: a value written as a fasl reads back equal
+        eval(read("(write-fasl '(1 (two \"three\") -4) \"" + dir + "/value.fasl\")"), env);
+        std::string result1 = toString(eval(read("(read-fasl \"" + dir + "/value.fasl\")"), env));
+        std::cout << "Test 1 - fasl round trip: " << result1 << " - "
+                  << (result1 == "(1 (two \"three\") -4)" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: a file that is not a fasl is refused
+        writeText(dir + "/text.fasl", "(1 2 3)");
+        std::string result2;
+        try {
+            eval(read("(read-fasl \"" + dir + "/text.fasl\")"), env);
+        } catch (const std::exception& e) {
+            result2 = e.what();
+        }
+        std::cout << "Test 2 - read-fasl of text: " << result2 << " - "
+                  << (result2.rfind("Not a fasl file", 0) == 0 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: without --module-cache, load leaves no cache behind
+        std::string source = "(define sq (x) (mul x x))";
+        writeText(dir + "/lib.yisp", source);
+        moduleCacheDir.clear();
+        eval(read("(load \"" + dir + "/lib.yisp\")"), env);
+        std::string result3 = toString(eval(read("(sq 3)"), env)) + " " + std::to_string(filesIn(cacheDir));
+        std::cout << "Test 3 - load with the cache off: " << result3 << " - "
+                  << (result3 == "9 0" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: the first load with the cache on is a miss and fills it
+        moduleCacheDir = cacheDir;
+        eval(read("(load \"" + dir + "/lib.yisp\")"), env);
+        std::string result4 = std::to_string(filesIn(cacheDir));
+        std::cout << "Test 4 - cache miss writes a fasl: " << result4 << " - "
+                  << (result4 == "1" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 5: a load of the same text is a hit: it runs the cached forms, not the text
+        std::string cached = cacheDir + "/" + sourceHash(source) + "-v" + std::to_string(moduleCacheFormat) + ".fasl";
+        writeFasl(read("((define sq (x) (add x x)))"), cached);
+        eval(read("(load \"" + dir + "/lib.yisp\")"), env);
+        std::string result5 = toString(eval(read("(sq 3)"), env));
+        std::cout << "Test 5 - cache hit: " << result5 << " - "
+                  << (result5 == "6" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 6: changed text misses and gets an entry of its own
+        writeText(dir + "/lib.yisp", "(define sq (x) (mul x (mul x x)))");
+        eval(read("(load \"" + dir + "/lib.yisp\")"), env);
+        std::string result6 = toString(eval(read("(sq 3)"), env)) + " " + std::to_string(filesIn(cacheDir));
+        std::cout << "Test 6 - changed source: " << result6 << " - "
+                  << (result6 == "27 2" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 7: a damaged cache entry is read past and rewritten
+        writeText(dir + "/lib.yisp", source);
+        writeText(cached, "garbage");
+        eval(read("(load \"" + dir + "/lib.yisp\")"), env);
+        std::string result7 = toString(eval(read("(sq 3)"), env)) + " " + toString(readFasl(cached));
+        std::cout << "Test 7 - damaged cache entry: " << result7 << " - "
+                  << (result7 == "9 ((define sq (x) (mul x x)))" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 8: file names are strings, from any expression; a symbol or number is refused
+        eval(read("(set lib (string-append \"" + dir + "\" \"/lib.yisp\"))"), env);
+        std::string result8 = toString(eval(read("(load lib)"), env));
+        for (const char* bad : { "(load lib.yisp)", "(read-fasl 5)", "(store-open 'state.db)" }) {
+            try {
+                eval(read(bad), env);
+                result8 += " ok";
+            } catch (const std::exception& e) {
+                result8 += std::string(" ") + e.what();
+            }
+        }
+        std::cout << "Test 8 - file name arguments: " << result8 << " - "
+                  << (result8 == "1 Symbol not found: lib.yisp read-fasl requires a string store-open requires a string"
+                      ? "PASS" : "FAIL") << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 11 tests: " << e.what() << std::endl;
+    }
+    moduleCacheDir = saved;
+    filesIn(cacheDir, true);
+    filesIn(dir, true);
+}
@@ -0,0 +1,61 @@
+// yispc's own main would clash with the one running the tests
+#define main yispcMain
+#include "../tools/yispc.cpp"
+#undef main
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into tools/yispc.cpp below its main() function
+ // 2. Call "testSprint12()" from a main function, run from the repository root 
+ //--------------------------------------------------------------------------------------------------------------------------------
+void testSprint12() {
+    std::string dir = "/tmp/yisp_sprint12_" + std::to_string(getpid());
+    std::string source = dir + "/rules.yisp";
+    std::string module = dir + "/rules.so";
+    mkdir(dir.c_str(), 0755);
+    try {
+        std::string text =
+            "(defmacro twice (e) (cons 'add (cons e (cons e nil))))\n"
+            "(define sq (x) (mul x x))\n"
+            "(define lazy (x) (force (delay (sq x))))\n"
+            "(define dbl (x) (twice x))\n"
+            "(define peek (x) (eval x))\n";
+        std::ofstream(source) << text;
+
+        // Test 1: only the define without special forms or macro calls is compiled
+        std::string code = compileModule(readAll(text), source);
+        bool compiled = code.find("fn_sq(const Cells& args) {") != std::string::npos;
+        bool interpreted = code.find("(define lazy (x)") != std::string::npos &&
+                           code.find("(define dbl (x)") != std::string::npos &&
+                           code.find("(define peek (x)") != std::string::npos &&
+                           code.find("(defmacro twice (e)") != std::string::npos;
+        bool noCallGlobal = code.find("callGlobal(\"delay\"") == std::string::npos &&
+                            code.find("callGlobal(\"twice\"") == std::string::npos;
+        std::cout << "Test 1 - generated module: " << compiled << interpreted << noCallGlobal << " - "
+                  << (compiled && interpreted && noCallGlobal ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: the module builds and registers the one compiled function
+        char* args[] = { const_cast<char*>("yispc"), &source[0], const_cast<char*>("-o"), &module[0], nullptr };
+        int rc = yispcMain(4, args);
+        EnvironmentPtr env = createGlobalEnv();
+        std::string result2 = rc == 0 ? toString(eval(read("(load-native \"" + module + "\")"), env)) : "rc " + std::to_string(rc);
+        std::cout << "Test 2 - load-native: " << result2 << " - "
+                  << (result2 == "1" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: compiled and interpreted functions of the module work together
+        std::string result3 = toString(eval(read("(sq 5)"), env)) + " " + toString(eval(read("(lazy 4)"), env)) + " " +
+                              toString(eval(read("(dbl 7)"), env)) + " " + toString(eval(read("(peek '(sq 3))"), env));
+        std::cout << "Test 3 - calls across the module: " << result3 << " - "
+                  << (result3 == "25 16 14 9" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: what fell back is an ordinary Lambda, what compiled is native
+        bool kinds = env->find("sq")->type == Proc && env->find("lazy")->type == Lambda &&
+                     env->find("twice")->type == Macro;
+        std::cout << "Test 4 - binding kinds: " << kinds << " - " << (kinds ? "PASS" : "FAIL") << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 12 tests: " << e.what() << std::endl;
+    }
+    unlink(source.c_str());
+    unlink(module.c_str());
+    rmdir(dir.c_str());
+}
@@ -0,0 +1,83 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the batch() function
+ // 2. Add "testSprint13()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+// What a fresh session prints for `input`, errors included: repl() when jobs is 0, batch() otherwise
+std::string sessionOutput(const std::string& input, unsigned jobs) {
+    std::istringstream in(input);
+    std::ostringstream out;
+    std::streambuf* oldIn = std::cin.rdbuf(in.rdbuf());
+    std::streambuf* oldOut = std::cout.rdbuf(out.rdbuf());
+    std::streambuf* oldErr = std::cerr.rdbuf(out.rdbuf());
+    try {
+        EnvironmentPtr env = createGlobalEnv();
+        if (jobs == 0) repl("", env);
+        else batch("", env, jobs);
+    } catch (...) {
+        std::cin.rdbuf(oldIn);
+        std::cout.rdbuf(oldOut);
+        std::cerr.rdbuf(oldErr);
+        throw;
+    }
+    std::cin.rdbuf(oldIn);
+    std::cout.rdbuf(oldOut);
+    std::cerr.rdbuf(oldErr);
+    return out.str();
+}
+
+// True when the lines of `text` include `order` in that order
+bool inOrder(const std::string& text, std::initializer_list<const char*> order) {
+    size_t at = 0;
+    for (const char* line : order) {
+        at = ("\n" + text).find("\n" + std::string(line) + "\n", at);
+        if (at == std::string::npos) return false;
+        at++;
+    }
+    return true;
+}
+
+void testSprint13() {
+    try {
+        // Test 1: defines, sets, calls, errors and a form over two lines give the REPL's output
+        std::string mixed =
+            "(define f (n) (g (add n 1)))\n"
+            "(define g (n) (mul n 2))\n"
+            "(f 1)\n"
+            "(set x 10)\n"
+            "(add x (f 2))\n"
+            "(car 5)\n"
+            "(f\n"
+            "  3)\n"
+            "(set x (add x 1))\n"
+            "x\n"
+            "undefined-name\n"
+            "(define g (n) (sub n 1))\n"
+            "(f 1)\n";
+        std::string repl1 = sessionOutput(mixed, 0);
+        std::string batch1 = sessionOutput(mixed, 4);
+        std::cout << "Test 1 - batch -j 4 output matches the REPL: " << (batch1 == repl1) << " - "
+                  << (batch1 == repl1 && inOrder(batch1, { "4", "16", "8", "11", "1" }) ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: a function that calls room runs in order and on the thread that read the forms
+        std::string heap = sessionOutput("(define r () (room))\n(add 1 0)\n(r)\n(add 2 0)\n(r)\n", 4);
+        bool ordered2 = inOrder(heap, { "r", "1", "type                  live         total", "2",
+                                        "type                  live         total" });
+        bool counted2 = heap.find("\nSymbol                   0") == std::string::npos;
+        std::cout << "Test 2 - room called through a function: " << ordered2 << counted2 << " - "
+                  << (ordered2 && counted2 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: the barrier is found through functions defined later and through a renamed primitive
+        std::string late = sessionOutput(
+            "(define f () (g))\n(define g () (room))\n(add 3 0)\n(f)\n(add 4 0)\n"
+            "(set heap room)\n(define h () (heap))\n(add 5 0)\n(h)\n(add 6 0)\n", 4);
+        bool ordered3 = inOrder(late, { "3", "type                  live         total", "4", "5",
+                                        "type                  live         total", "6" });
+        std::cout << "Test 3 - barrier through a later define and a renamed primitive: " << ordered3 << " - "
+                  << (ordered3 ? "PASS" : "FAIL") << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 13 tests: " << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,54 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint14()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+// The names a Lambda's environment binds itself, space separated
+std::string capturedNames(const CellPtr& lambda) {
+    std::string names;
+    for (auto& binding : lambda->env()->symbols) names += (names.empty() ? "" : " ") + binding.first;
+    return names;
+}
+
+void testSprint14() {
+    try {
+        EnvironmentPtr env = createGlobalEnv();
+
+        // Test 1: a closure keeps only the free variable it uses, not the rest of the frame
+        eval(read("(define mk (n big) (and (define add-n (x) (+ x n)) add-n))"), env);
+        eval(read("(set a5 (mk 5 '(1 2 3)))"), env);
+        CellPtr a5 = env->find("a5");
+        std::string result1 = toString(eval(read("(a5 10)"), env)) + " " + capturedNames(a5);
+        bool flat1 = a5->lambda()->flatClosure && a5->env()->captured && a5->env()->outer == env;
+        std::cout << "Test 1 - flat capture: " << result1 << " " << flat1 << " - "
+                  << (result1 == "15 n" && flat1 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: globals are not copied, so a later global set is seen
+        eval(read("(set k 1)"), env);
+        eval(read("(define mk2 (n) (and (define f (x) (+ x k)) f))"), env);
+        eval(read("(set g2 (mk2 0))"), env);
+        eval(read("(set k 2)"), env);
+        std::string result2 = toString(eval(read("(g2 0)"), env)) + " [" + capturedNames(env->find("g2")) + "]";
+        std::cout << "Test 2 - global set after capture: " << result2 << " - "
+                  << (result2 == "2 []" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: a frame that sets its own variables keeps the whole environment, so the set is seen
+        eval(read("(define mk3 (n) (and (define f (x) (+ x n)) (and (set n 10) f)))"), env);
+        eval(read("(set g3 (mk3 1))"), env);
+        std::string result3 = toString(eval(read("(g3 0)"), env));
+        bool flat3 = env->find("g3")->lambda()->flatClosure;
+        std::cout << "Test 3 - set in the defining frame: " << result3 << " " << flat3 << " - "
+                  << (result3 == "10" && !flat3 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: a flat closure calls itself by name
+        eval(read("(define mk4 (n) (and (define fact (x) (if (< x 1) 1 (* x (fact (- x 1))))) fact))"), env);
+        eval(read("(set g4 (mk4 0))"), env);
+        std::string result4 = toString(eval(read("(g4 5)"), env)) + " [" + capturedNames(env->find("g4")) + "]";
+        std::cout << "Test 4 - recursive flat closure: " << result4 << " - "
+                  << (result4 == "120 []" ? "PASS" : "FAIL") << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 14 tests: " << e.what() << std::endl;
+    }
+}
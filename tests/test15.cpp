@@ -0,0 +1,54 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint15()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+void testSprint15() {
+    size_t savedStack = evalStackBytes;
+    try {
+        EnvironmentPtr env = createGlobalEnv();
+        const size_t depth = 100000;
+
+        // Test 1: a 100k-deep quoted list reads, evaluates and prints without recursing on the C++ stack
+        std::string text = "(quote " + std::string(depth, '(') + std::string(depth, ')') + ")";
+        long liveBefore = threadHeap.stats.liveCells[List];
+        std::string printed;
+        {
+            CellPtr value = eval(read(text), env);
+            printed = toString(value);
+        }
+        bool result1 = printed == std::string(depth, '(') + std::string(depth, ')');
+        std::cout << "Test 1 - 100k-deep read and print: " << printed.size() << " - "
+                  << (result1 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: freeing the deep list gives back every Cell
+        long result2 = threadHeap.stats.liveCells[List] - liveBefore;
+        std::cout << "Test 2 - 100k-deep list freed: " << result2 << " lists left - "
+                  << (result2 == 0 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: recursion past the stack budget is an error, not a crash
+        evalStackBytes = 16ul << 20;
+        eval(read("(define down (n) (if (< n 1) 0 (+ 1 (down (- n 1)))))"), env);
+        std::string result3;
+        runOnEvalStack([&]() {
+            try {
+                eval(read("(down 10000000)"), env);
+            } catch (const std::exception& e) {
+                result3 = e.what();
+            }
+        });
+        std::cout << "Test 3 - recursion past the budget: " << result3 << " - "
+                  << (result3 == "Recursion too deep: stack budget of 16 MB exhausted" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: the session goes on after the error
+        std::string result4;
+        runOnEvalStack([&]() { result4 = toString(eval(read("(down 10000)"), env)); });
+        std::cout << "Test 4 - recursion within the budget afterwards: " << result4 << " - "
+                  << (result4 == "10000" ? "PASS" : "FAIL") << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 15 tests: " << e.what() << std::endl;
+    }
+    evalStackBytes = savedStack;
+}
@@ -0,0 +1,69 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint16()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+std::string limitError(const std::string& input, EnvironmentPtr env) {
+    std::string result;
+    runOnEvalStack([&]() {
+        try {
+            result = toString(eval(read(input), env));
+        } catch (const LimitExceeded& e) {
+            result = e.what();
+        }
+    });
+    return result;
+}
+
+void testSprint16() {
+    try {
+        EnvironmentPtr env = createGlobalEnv();
+        eval(read("(define spin (n) (spin (+ n 1)))"), env);
+        eval(read("(define count (n) (if (< n 1) 0 (count (- n 1))))"), env);
+        eval(read("(define grow (xs) (grow (cons 1 xs)))"), env);
+
+        // Test 1: a runaway loop stops at its step budget and the budget is lifted afterwards
+        std::string result1 = limitError("(with-limits (steps 100000) (spin 0))", env);
+        std::cout << "Test 1 - step limit: " << result1 << " - "
+                  << (result1 == "Step limit exceeded" && !evalLimits.active ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: steps used by an inner budget are charged to the enclosing one
+        long used;
+        {
+            LimitScope scope(1000000, 0, 0);
+            eval(read("(count 100)"), env);
+            used = 1000000 - evalLimits.steps;
+        }
+        std::string outer = "(with-limits (steps " + std::to_string(used * 3 / 2 + 10) + ") ";
+        std::string inner = "(with-limits (steps " + std::to_string(used + 10) + ") (count 100))";
+        std::string once = limitError(outer + inner + ")", env);
+        std::string twice = limitError(outer + "(and " + inner + " " + inner + "))", env);
+        std::cout << "Test 2 - nested step budgets: " << once << " " << twice << " - "
+                  << (once == "0" && twice == "Step limit exceeded" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: an inner budget cannot loosen the enclosing one
+        std::string result3 = limitError("(with-limits (steps 1000) (with-limits (steps 1000000) (count 1000)))", env);
+        std::cout << "Test 3 - inner budget is no looser: " << result3 << " - "
+                  << (result3 == "Step limit exceeded" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: a wall-clock deadline stops the loop close to its time
+        auto start = LimitClock::now();
+        std::string result4 = limitError("(with-limits (time 50) (spin 0))", env);
+        long ms = std::chrono::duration_cast<std::chrono::milliseconds>(LimitClock::now() - start).count();
+        std::cout << "Test 4 - time limit: " << result4 << " after " << ms << " ms - "
+                  << (result4 == "Time limit exceeded" && ms >= 50 && ms < 2000 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 5: allocating past the memory quota stops the loop
+        std::string result5 = limitError("(with-limits (memory 1000000) (grow (quote ())))", env);
+        std::cout << "Test 5 - memory limit: " << result5 << " - "
+                  << (result5 == "Memory limit exceeded" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 6: work inside every budget returns its value
+        std::string result6 = limitError("(with-limits (steps 1000) (memory 1000000) (time 1000) (+ 1 2))", env);
+        std::cout << "Test 6 - within budget: " << result6 << " - "
+                  << (result6 == "3" ? "PASS" : "FAIL") << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 16 tests: " << e.what() << std::endl;
+    }
+}
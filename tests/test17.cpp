@@ -0,0 +1,58 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint17()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+void testSprint17() {
+    try {
+        EnvironmentPtr env = createGlobalEnv();
+
+        // Test 1: lists nested deeper than printDepth print as #
+        printDepth = 2;
+        std::string result1 = toString(eval(read("(quote (1 (2 (3 4)) 5))"), env));
+        printDepth = 0;
+        std::cout << "Test 1 - print depth: " << result1 << " - "
+                  << (result1 == "(1 (2 #) 5)" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: elements past printLength print as ..., at every level
+        printLength = 3;
+        std::string result2 = toString(eval(read("(quote (1 2 (3 4 5 6) 7 8))"), env));
+        printLength = 0;
+        std::cout << "Test 2 - print length: " << result2 << " - "
+                  << (result2 == "(1 2 (3 4 5 ...) ...)" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: a list that contains itself prints <cycle> instead of running forever
+        CellPtr loop = std::make_shared<Cell>(List);
+        loop->mutableList().push_back(makeNumber(1));
+        loop->mutableList().push_back(loop);
+        std::string printed3 = toString(loop);
+        loop->mutableList().clear();
+        bool result3 = printed3.size() < 4 * cycleCheckDepth + 16 &&
+                       printed3.find("<cycle>") != std::string::npos &&
+                       printed3.compare(printed3.size() - 2, 2, "))") == 0;
+        std::cout << "Test 3 - cycle detection: " << printed3.size() << " chars - "
+                  << (result3 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: a 1M-element list prints into one buffer, element by element
+        const long count = 1000000;
+        CellPtr big = std::make_shared<Cell>(List);
+        for (long i = 0; i < count; i++) big->mutableList().push_back(makeNumber(i % 10));
+        auto start = std::chrono::steady_clock::now();
+        std::string printed4 = toString(big);
+        long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        bool result4 = printed4.size() == static_cast<size_t>(2 * count + 1) &&
+                       printed4.compare(0, 8, "(0 1 2 3") == 0 && printed4.back() == ')';
+        std::cout << "Test 4 - 1M-element list: " << printed4.size() << " chars in " << ms << " ms - "
+                  << (result4 && ms < 2000 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 5: strings print quoted and unchanged inside lists
+        std::string result5 = toString(eval(read("(quote (\"a b\" c))"), env));
+        std::cout << "Test 5 - strings in lists: " << result5 << " - "
+                  << (result5 == "(\"a b\" c)" ? "PASS" : "FAIL") << std::endl;
+    } catch (const std::exception& e) {
+        printDepth = 0;
+        printLength = 0;
+        std::cerr << "Error during Sprint 17 tests: " << e.what() << std::endl;
+    }
+}
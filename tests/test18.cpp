@@ -0,0 +1,92 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint18()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+// The forms a FormReader hands out, each joined back into one line
+std::vector<std::string> completeForms(FormReader& reader) {
+    std::vector<std::string> forms;
+    std::vector<std::string> tokens;
+    while (reader.next(tokens)) {
+        std::string form;
+        for (const std::string& token : tokens) form += (form.empty() ? "" : " ") + token;
+        forms.push_back(form);
+    }
+    return forms;
+}
+
+// What repl() prints for `input`, errors included
+std::string replOutput(const std::string& input) {
+    std::istringstream in(input);
+    std::ostringstream out;
+    std::streambuf* oldIn = std::cin.rdbuf(in.rdbuf());
+    std::streambuf* oldOut = std::cout.rdbuf(out.rdbuf());
+    std::streambuf* oldErr = std::cerr.rdbuf(out.rdbuf());
+    repl("", createGlobalEnv());
+    std::cin.rdbuf(oldIn);
+    std::cout.rdbuf(oldOut);
+    std::cerr.rdbuf(oldErr);
+    return out.str();
+}
+
+void testSprint18() {
+    try {
+        // Test 1: a form split across lines is handed out once its last line closes it
+        FormReader reader1;
+        reader1.feedLine("(define inc (x)");
+        bool open1 = reader1.pending() && reader1.complete.empty();
+        reader1.feedLine("  (+ x 1))");
+        std::vector<std::string> forms1 = completeForms(reader1);
+        bool result1 = open1 && !reader1.pending() && forms1.size() == 1 &&
+                       forms1[0] == "( define inc ( x ) ( + x 1 ) )";
+        std::cout << "Test 1 - form across lines: " << (forms1.empty() ? "" : forms1[0]) << " - "
+                  << (result1 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: every form on a line is handed out, atoms included
+        FormReader reader2;
+        reader2.feedLine("(inc 1) (inc 2) 7");
+        std::vector<std::string> forms2 = completeForms(reader2);
+        bool result2 = forms2 == std::vector<std::string>{ "( inc 1 )", "( inc 2 )", "7" };
+        std::cout << "Test 2 - several forms on a line: " << forms2.size() << " forms - "
+                  << (result2 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: parens and line breaks inside a string do not end the form
+        FormReader reader3;
+        reader3.feedLine("(string-length \"a ) (");
+        bool open3 = reader3.pending() && reader3.complete.empty();
+        reader3.feedLine("b\")");
+        std::vector<std::string> forms3 = completeForms(reader3);
+        bool result3 = open3 && forms3.size() == 1 && forms3[0] == "( string-length \"a ) (\nb\" )";
+        std::cout << "Test 3 - parens inside a string: " << forms3.size() << " forms - "
+                  << (result3 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: a quote waits for the form it quotes, even on the next line
+        FormReader reader4;
+        reader4.feedLine("'");
+        bool open4 = reader4.pending() && reader4.complete.empty();
+        reader4.feedLine("(1 2) 'a");
+        std::vector<std::string> forms4 = completeForms(reader4);
+        bool result4 = open4 && forms4 == std::vector<std::string>{ "' ( 1 2 )", "' a" };
+        std::cout << "Test 4 - quote across lines: " << forms4.size() << " forms - "
+                  << (result4 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 5: feeding one byte at a time cuts the same tokens as tokenize() on the whole text
+        std::string text5 = "(define twice (x) (* 2 x))\n(twice \"s t\") 'q\n(twice\n 4)\n";
+        FormReader reader5;
+        for (char c : text5) reader5.feed(&c, 1);
+        std::vector<std::string> tokens5;
+        std::vector<std::string> form;
+        while (reader5.next(form)) tokens5.insert(tokens5.end(), form.begin(), form.end());
+        bool result5 = tokens5 == tokenize(text5);
+        std::cout << "Test 5 - byte by byte: " << tokens5.size() << " tokens - "
+                  << (result5 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 6: repl() evaluates forms spanning lines and several forms per line, in order
+        std::string result6 = replOutput("(define inc (x)\n  (+ x 1))\n(inc 1) (inc 2)\n(inc\n");
+        std::cout << "Test 6 - repl over the reader: " << std::quoted(result6) << " - "
+                  << (result6 == "inc\n2\n3\nError: Unexpected EOF\n" ? "PASS" : "FAIL") << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 18 tests: " << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,63 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint19()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+// Evaluates input on the eval stack and prints the result, or the error it raised
+std::string streamResult(const std::string& input, EnvironmentPtr env) {
+    std::string result;
+    runOnEvalStack([&]() {
+        try {
+            result = toString(eval(read(input), env));
+        } catch (const std::exception& e) {
+            result = e.what();
+        }
+    });
+    return result;
+}
+
+void testSprint19() {
+    try {
+        EnvironmentPtr env = createGlobalEnv();
+        streamResult("(define ints (n) (stream-cons n (ints (+ n 1))))", env);
+        streamResult("(define sq (x) (* x x))", env);
+        streamResult("(define even (x) (= (% x 2) 0))", env);
+
+        // Test 1: delay waits for force, and force evaluates the expression only once
+        streamResult("(set hits 0)", env);
+        streamResult("(set p (delay (and (set hits (+ hits 1)) 42)))", env);
+        std::string result1 = streamResult("hits", env);
+        for (const char* input : { "(force p)", "(force p)", "hits" }) result1 += " " + streamResult(input, env);
+        std::cout << "Test 1 - promise forced once: " << result1 << " - "
+                  << (result1 == "0 42 42 1" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: a forced stream tail is kept, so forcing it again gives the same cells
+        CellPtr stream = eval(read("(ints 0)"), env);
+        CellPtr first = force(stream->list()[1]);
+        CellPtr again = force(stream->list()[1]);
+        bool result2 = first == again && toString(first->list()[0]) == "1";
+        std::cout << "Test 2 - stream tail memoized: " << (first == again) << " - "
+                  << (result2 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: take only forces the prefix it returns of an infinite stream
+        std::string result3 = streamResult("(stream-take (ints 0) 5)", env);
+        std::cout << "Test 3 - take from an infinite stream: " << result3 << " - "
+                  << (result3 == "(0 1 2 3 4)" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: stream-map and stream-filter stay lazy over an infinite source
+        std::string result4 = streamResult("(stream-take (stream-filter even (stream-map sq (ints 1))) 3)", env);
+        std::cout << "Test 4 - lazy map and filter: " << result4 << " - "
+                  << (result4 == "(4 16 36)" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 5: walking 100k elements nobody holds fits in a 1MB quota; holding the head does not
+        std::string walked = streamResult("(with-limits (memory 1000000) (stream-ref (ints 0) 100000))", env);
+        streamResult("(set held (ints 0))", env);
+        std::string held = streamResult("(with-limits (memory 1000000) (stream-ref held 100000))", env);
+        streamResult("(set held 0)", env);
+        std::cout << "Test 5 - constant-memory walk: " << walked << ", " << held << " - "
+                  << (walked == "100000" && held == "Memory limit exceeded" ? "PASS" : "FAIL") << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 19 tests: " << e.what() << std::endl;
+    }
+}
@@ -29,9 +29,9 @@ void testSprint2() {
 
     // Test 3: Check if a symbol is an atom
     try {
-        CellPtr expr3 = read("(symbol? \"symbol\")");
+        CellPtr expr3 = read("(symbol? 'symbol)");
         std::string result3 = toString(eval(expr3, globalEnv));
-        std::cout << "Test 3 - symbol?(\"symbol\"): " << result3 << " - " 
+        std::cout << "Test 3 - symbol?('symbol): " << result3 << " - " 
                   << (result3 == "t" ? "PASS" : "FAIL") << std::endl;
     } catch (const std::exception& e) {
         std::cerr << "Test 3 failed: " << e.what() << std::endl;
@@ -39,9 +39,9 @@ void testSprint2() {
 
     // Test 4: Check if a number is a number
     try {
-        CellPtr expr4 = read("(number? \"411\")");
+        CellPtr expr4 = read("(number? 411)");
         std::string result4 = toString(eval(expr4, globalEnv));
-        std::cout << "Test 4 - number?(\"411\"): " << result4 << " - " 
+        std::cout << "Test 4 - number?(411): " << result4 << " - " 
                   << (result4 == "t" ? "PASS" : "FAIL") << std::endl;
     } catch (const std::exception& e) {
         std::cerr << "Test 4 failed: " << e.what() << std::endl;
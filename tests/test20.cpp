@@ -0,0 +1,81 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint20()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+std::string pipelineResult(const std::string& input, EnvironmentPtr env) {
+    try {
+        return toString(eval(read(input), env));
+    } catch (const std::exception& e) {
+        return e.what();
+    }
+}
+
+void testSprint20() {
+    try {
+        EnvironmentPtr env = createGlobalEnv();
+        CellPtr xs = std::make_shared<Cell>(List);
+        for (long i = 0; i < 100000; i++) xs->mutableList().push_back(makeNumber(i % 1000));
+        env->define("xs", xs);
+        pipelineResult("(define sq (x) (* x x))", env);
+        pipelineResult("(define even (x) (= (% x 2) 0))", env);
+        pipelineResult("(define small (x) (< x 500))", env);
+
+        // Test 1: fused chains give what running each stage on its own list gives
+        std::vector<std::pair<const char*, std::vector<const char*>>> cases = {
+            { "(reduce + 0 (map sq (filter even xs)))", { "(set s1 (filter even xs))", "(set s2 (map sq s1))", "(reduce + 0 s2)" } },
+            { "(filter small (map sq (filter even xs)))", { "(set s1 (filter even xs))", "(set s2 (map sq s1))", "(filter small s2)" } },
+            { "(map sq (map sq (quote (1 2 3))))", { "(set s1 (map sq (quote (1 2 3))))", "(map sq s1)" } },
+            { "(reduce + 7 (filter even nil))", { "(set s1 (filter even nil))", "(reduce + 7 s1)" } },
+        };
+        bool result1 = true;
+        for (auto& c : cases) {
+            std::string unfused;
+            for (const char* step : c.second) unfused = pipelineResult(step, env);
+            result1 = result1 && pipelineResult(c.first, env) == unfused;
+        }
+        pipelineResult("(set s1 0)", env);
+        pipelineResult("(set s2 0)", env);
+        std::cout << "Test 1 - fused equals unfused: " << cases.size() << " chains - "
+                  << (result1 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: a fused reduce builds no list between its stages
+        CellPtr form2 = read("(reduce + 0 (map sq (filter even xs)))");
+        unsigned long listsBefore = threadHeap.stats.totalCells[List];
+        threadHeap.stats.peakBytes = threadHeap.stats.liveBytes;
+        long bytesBefore = threadHeap.stats.liveBytes;
+        std::string sum2 = toString(eval(form2, env));
+        unsigned long lists2 = threadHeap.stats.totalCells[List] - listsBefore;
+        long peak2 = threadHeap.stats.peakBytes - bytesBefore;
+        std::cout << "Test 2 - no intermediate lists: " << sum2 << " with " << lists2 << " new lists, "
+                  << peak2 << " bytes at peak - "
+                  << (lists2 == 0 && peak2 < 64 * 1024 && sum2 == "16616700000" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: each element passes every stage before the next element starts
+        std::string trace;
+        env->define("note", std::make_shared<Cell>([&trace](const Cells& args) {
+            trace += toString(args[0]) + " ";
+            return args[0];
+        }));
+        pipelineResult("(define tens (x) (note (* 10 x)))", env);
+        std::string result3 = pipelineResult("(map tens (map note (quote (1 2 3))))", env);
+        std::cout << "Test 3 - element by element: " << trace << "- "
+                  << (result3 == "(10 20 30)" && trace == "1 10 2 20 3 30 " ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: a map bound to a Lambda is called, not fused
+        EnvironmentPtr env4 = createGlobalEnv();
+        pipelineResult("(define map (f xs) 99)", env4);
+        pipelineResult("(define sq (x) (* x x))", env4);
+        std::string result4 = pipelineResult("(reduce + 0 (map sq (quote (1 2))))", env4);
+        std::cout << "Test 4 - rebound map not fused: " << result4 << " - "
+                  << (result4 == "reduce requires a list" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 5: errors name the stage whose list argument is wrong
+        std::string result5 = pipelineResult("(reduce + 0 (map sq (filter even 5)))", env);
+        std::cout << "Test 5 - error names the stage: " << result5 << " - "
+                  << (result5 == "filter requires a list" ? "PASS" : "FAIL") << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 20 tests: " << e.what() << std::endl;
+    }
+}
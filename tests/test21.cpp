@@ -0,0 +1,73 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint21()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+std::string stringResult(const std::string& input, EnvironmentPtr env) {
+    std::string result;
+    runOnEvalStack([&]() {
+        try {
+            result = toString(eval(read(input), env));
+        } catch (const std::exception& e) {
+            result = e.what();
+        }
+    });
+    return result;
+}
+
+void testSprint21() {
+    try {
+        EnvironmentPtr env = createGlobalEnv();
+
+        // Test 1: a literal is a String, even when its text looks like a number or a symbol
+        std::string result1 = stringResult("(string? \"42\")", env) + " " + stringResult("(number? \"42\")", env) + " " +
+                              stringResult("(symbol? \"abc\")", env) + " " + stringResult("\"42\"", env);
+        std::cout << "Test 1 - literals are strings: " << result1 << " - "
+                  << (result1 == "t nil nil \"42\"" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: substring takes an exclusive end that defaults to the length, and checks its range
+        std::vector<std::string> result2;
+        for (const char* input : { "(substring \"hello world\" 6)", "(substring \"hello\" 1 3)", "(substring \"hello\" 5)",
+                                   "(substring \"hello\" 2 9)", "(substring \"hello\" 3 2)" }) {
+            result2.push_back(stringResult(input, env));
+        }
+        bool pass2 = result2 == std::vector<std::string>{ "\"world\"", "\"el\"", "\"\"",
+                                                          "substring: position 9 is out of range",
+                                                          "substring: end comes before start" };
+        std::cout << "Test 2 - substring: " << result2[0] << " " << result2[1] << " - "
+                  << (pass2 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: string-search finds the first match at or after start, or nil
+        std::vector<std::string> result3;
+        for (const char* input : { "(string-search \"lo\" \"hello hello\")", "(string-search \"lo\" \"hello hello\" 4)",
+                                   "(string-search \"xyz\" \"hello\")", "(string-search \"\" \"hello\")" }) {
+            result3.push_back(stringResult(input, env));
+        }
+        bool pass3 = result3 == std::vector<std::string>{ "3", "9", "nil", "0" };
+        std::cout << "Test 3 - string-search: " << result3[0] << " " << result3[1] << " " << result3[2] << " - "
+                  << (pass3 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: appending one piece at a time builds a rope that reads like the flat text
+        stringResult("(define grow (s n) (if (< n 1) s (grow (string-append s \"abcdefghij\") (- n 1))))", env);
+        stringResult("(set r (string-append (grow \"\" 10000) \"XYZ\"))", env);
+        std::string flat;
+        for (int i = 0; i < 10000; i++) flat += "abcdefghij";
+        flat += "XYZ";
+        CellPtr rope = env->lookup("r");
+        std::string piece = stringResult("(substring r 12345 12360)", env);
+        bool result4 = !rope->list().empty() && stringText(rope) == flat &&
+                       stringResult("(string-length r)", env) == "100003" &&
+                       piece == "\"" + flat.substr(12345, 15) + "\"" &&
+                       stringResult("(string-search \"jXYZ\" r)", env) == "99999";
+        std::cout << "Test 4 - rope string: " << piece << " - "
+                  << (result4 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 5: string->list gives one-character strings
+        std::string result5 = stringResult("(string->list \"abc\")", env);
+        std::cout << "Test 5 - string->list: " << result5 << " - "
+                  << (result5 == "(\"a\" \"b\" \"c\")" ? "PASS" : "FAIL") << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 21 tests: " << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,122 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint7()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+// Calls (name 1) often enough for the tiers to compile name
+void warmUp(const std::string& name, EnvironmentPtr env) {
+    CellPtr call = read("(" + name + " 1)");
+    for (long i = 0; i <= std::max(jitThreshold, specThreshold); i++) eval(call, env);
+}
+
+void testSprint7() {
+    bool jit = jitEnabled;
+    bool specialize = specializeEnabled;
+
+    try {
+        // Test 1: native code compiled for + follows (set + -)
+        EnvironmentPtr env1 = createGlobalEnv();
+        jitEnabled = true;
+        specializeEnabled = false;
+        eval(read("(define inc (x) (+ x 1))"), env1);
+        warmUp("inc", env1);
+        eval(read("(set + -)"), env1);
+        std::string result1 = toString(eval(read("(inc 1)"), env1));
+        std::cout << "Test 1 - JIT after (set + -): " << result1 << " - "
+                  << (result1 == "0" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: a named builtin rebound to a Proc is seen by native code too
+        EnvironmentPtr env2 = createGlobalEnv();
+        eval(read("(define twice (x) (add x x))"), env2);
+        warmUp("twice", env2);
+        eval(read("(set add *)"), env2);
+        std::string result2 = toString(eval(read("(twice 3)"), env2));
+        std::cout << "Test 2 - JIT after (set add *): " << result2 << " - "
+                  << (result2 == "9" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: a specialized tree compiled for + follows (set + -)
+        EnvironmentPtr env3 = createGlobalEnv();
+        jitEnabled = false;
+        specializeEnabled = true;
+        eval(read("(define inc (x) (+ x 1))"), env3);
+        warmUp("inc", env3);
+        eval(read("(set + -)"), env3);
+        std::string result3 = toString(eval(read("(inc 1)"), env3));
+        std::cout << "Test 3 - specialized after (set + -): " << result3 << " - "
+                  << (result3 == "0" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: a recursive specialized function after its comparison is rebound
+        EnvironmentPtr env4 = createGlobalEnv();
+        eval(read("(define down (x) (if (lt x 1) 0 (add 1 (down (sub x 1)))))"), env4);
+        warmUp("down", env4);
+        eval(read("(set lt >)"), env4);
+        std::string result4 = toString(eval(read("(down 3)"), env4));
+        std::cout << "Test 4 - recursive specialized after (set lt >): " << result4 << " - "
+                  << (result4 == "0" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 5: a form prepared by the eval cache follows (set + -)
+        EnvironmentPtr env5 = createGlobalEnv();
+        for (int i = 0; i < 3; i++) eval(read("(eval '(+ 1 2))"), env5);
+        eval(read("(set + -)"), env5);
+        std::string result5 = toString(eval(read("(eval '(+ 1 2))"), env5));
+        std::cout << "Test 5 - eval cache after (set + -): " << result5 << " - "
+                  << (result5 == "-1" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 6: a set inside a function binds its frame; the global inc keeps its tiers
+        EnvironmentPtr env6 = createGlobalEnv();
+        eval(read("(define inc (x) (+ x 1))"), env6);
+        warmUp("inc", env6);
+        eval(read("(define shadow (x) (and (set + -) (+ x 1)))"), env6);
+        std::string result6 = toString(eval(read("(shadow 5)"), env6)) + " " + toString(eval(read("(inc 1)"), env6));
+        bool kept6 = env6->find("inc")->lambda()->specState.load() == TierReady;
+        std::cout << "Test 6 - local (set + -) leaves global tiers: " << result6 << " " << kept6 << " - "
+                  << (result6 == "4 2" && kept6 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 7: a specialized tree retired by a rebinding its own call reached keeps running
+        std::string rebind = "/tmp/yisp_sprint7_" + std::to_string(getpid()) + ".yisp";
+        std::ofstream(rebind) << "(set + -)";
+        EnvironmentPtr env7 = createGlobalEnv();
+        eval(read("(set armed 0)"), env7);
+        eval(read("(define g (x) (cond ((eq armed 1) (load \"" + rebind + "\")) (t 0)))"), env7);
+        eval(read("(define f (x) (if (< x 1) (and (g 0) 0) (+ 1 (f (- x 1)))))"), env7);
+        CellPtr call7 = read("(f 2)");
+        for (long i = 0; i <= specThreshold; i++) eval(call7, env7);
+        bool ready7 = env7->find("f")->lambda()->specState.load() == TierReady;
+        eval(read("(set armed 1)"), env7);
+        std::string result7 = toString(eval(read("(f 3)"), env7));
+        eval(read("(set armed 0)"), env7);
+        result7 += " " + toString(eval(read("(f 3)"), env7));
+        unlink(rebind.c_str());
+        bool freed7 = retiredSpecs.running == 0 && retiredSpecs.trees.empty();
+        std::cout << "Test 7 - tree retired while it runs: " << ready7 << " " << result7 << " " << freed7 << " - "
+                  << (ready7 && result7 == "3 1" && freed7 ? "PASS" : "FAIL") << std::endl;
+
+        // Test 8: native code that bails out with operands still pushed returns cleanly
+        EnvironmentPtr env8 = createGlobalEnv();
+        jitEnabled = true;
+        specializeEnabled = false;
+        eval(read("(define q (x) (+ 1 (/ 6 x)))"), env8);
+        eval(read("(define down (n) (if (< n 1) 0 (+ 1 (down (- n 1)))))"), env8);
+        warmUp("q", env8);
+        warmUp("down", env8);
+        std::string result8;
+        try {
+            eval(read("(q 0)"), env8);
+        } catch (const std::exception& e) {
+            result8 = e.what();
+        }
+        runOnEvalStack([&]() {
+            result8 += " " + toString(eval(read("(q 3)"), env8)) + " " + toString(eval(read("(down 30000)"), env8));
+        });
+        bool native8 = env8->find("q")->lambda()->jitState.load() == TierReady &&
+                       env8->find("down")->lambda()->jitState.load() == TierReady;
+        std::cout << "Test 8 - native bail-outs: " << result8 << " " << native8 << " - "
+                  << (result8 == "Division by zero 3 30000" && native8 ? "PASS" : "FAIL") << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 7 tests: " << e.what() << std::endl;
+    }
+    jitEnabled = jit;
+    specializeEnabled = specialize;
+}
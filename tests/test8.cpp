@@ -0,0 +1,46 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint8()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+void testSprint8() {
+    try {
+        EnvironmentPtr env = createGlobalEnv();
+        eval(read("(defmacro inc1 (a) (cons 'add (cons a '(1))))"), env);
+
+        // Test 1: evaluating quoted data that calls a macro leaves the data alone
+        eval(read("(set c '(inc1 1))"), env);
+        std::string result1 = toString(eval(read("(eval c)"), env));
+        result1 += " " + toString(eval(read("c"), env));
+        std::cout << "Test 1 - eval('(inc1 1)): " << result1 << " - "
+                  << (result1 == "2 (inc1 1)" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: a define form held as data keeps its body
+        eval(read("(set d '(define g (x) (inc1 x)))"), env);
+        eval(read("(eval d)"), env);
+        std::string result2 = toString(eval(read("(g 5)"), env));
+        result2 += " " + toString(eval(read("d"), env));
+        std::cout << "Test 2 - eval('(define g ...)): " << result2 << " - "
+                  << (result2 == "6 (define g (x) (inc1 x))" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: a call expanded at run time gives the same result every time
+        eval(read("(set e '(inc1 (inc1 1)))"), env);
+        std::string result3;
+        for (int i = 0; i < 3; i++) result3 += toString(eval(read("(eval e)"), env));
+        std::cout << "Test 3 - repeated eval('(inc1 (inc1 1))): " << result3 << " - "
+                  << (result3 == "333" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: a macro defined after the function that calls it, once the function is hot
+        eval(read("(define later (x) (twice x))"), env);
+        eval(read("(defmacro twice (a) (cons 'mul (cons a '(2))))"), env);
+        CellPtr call = read("(later 21)");
+        std::string result4;
+        for (long i = 0; i <= std::max(jitThreshold, specThreshold); i++) result4 = toString(eval(call, env));
+        std::cout << "Test 4 - hot function using a later macro: " << result4 << " - "
+                  << (result4 == "42" ? "PASS" : "FAIL") << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 8 tests: " << e.what() << std::endl;
+    }
+}
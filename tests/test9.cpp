@@ -0,0 +1,57 @@
+#include "lisp.cpp"
+
+//To run Sprint Test:
+ // 1. copy and paste the code below the line into lisp.cpp below the repl() function
+ // 2. Add "testSprint9()" into the main function and compile & run 
+ //--------------------------------------------------------------------------------------------------------------------------------
+// The error eval throws for `code`, or "" when it returns
+std::string errorOf(const std::string& code, EnvironmentPtr env) {
+    try {
+        eval(read(code), env);
+    } catch (const std::exception& e) {
+        return e.what();
+    }
+    return "";
+}
+
+void testSprint9() {
+    try {
+        EnvironmentPtr env = createGlobalEnv();
+
+        // Test 1: recv with no task that could ever send
+        eval(read("(set c (chan))"), env);
+        std::string result1 = errorOf("(recv c)", env);
+        std::cout << "Test 1 - recv on an empty channel, no tasks: " << result1 << " - "
+                  << (result1 == "Deadlock: recv on an empty channel and no task can run" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 2: the only task is itself blocked on another channel
+        eval(read("(set d (chan))"), env);
+        eval(read("(go (set got (recv d)))"), env);
+        std::string result2 = errorOf("(recv c)", env);
+        std::cout << "Test 2 - recv while every task is blocked: " << result2 << " - "
+                  << (result2 == "Deadlock: recv on an empty channel and no task can run" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 3: send on a full channel nobody reads
+        eval(read("(set e (chan 1))"), env);
+        eval(read("(send e 1)"), env);
+        std::string result3 = errorOf("(send e 2)", env);
+        std::cout << "Test 3 - send on a full channel: " << result3 << " - "
+                  << (result3 == "Deadlock: send on a full channel and no task can run" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 4: after a deadlock, a task that can serve the channel still does
+        eval(read("(go (send c (add 2 3)))"), env);
+        std::string result4 = toString(eval(read("(recv c)"), env));
+        std::cout << "Test 4 - recv served by a task after a deadlock: " << result4 << " - "
+                  << (result4 == "5" ? "PASS" : "FAIL") << std::endl;
+
+        // Test 5: the task blocked in Test 2 is woken by a send
+        eval(read("(send d 7)"), env);
+        eval(read("(yield)"), env);
+        std::string result5 = toString(eval(read("got"), env));
+        std::cout << "Test 5 - blocked task resumed: " << result5 << " - "
+                  << (result5 == "7" ? "PASS" : "FAIL") << std::endl;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error during Sprint 9 tests: " << e.what() << std::endl;
+    }
+}
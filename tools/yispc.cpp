@@ -0,0 +1,396 @@
+#define YISP_NO_MAIN
+#include "../lisp.cpp"
+
+#include <fstream>
+#include <set>
+#include <sys/wait.h>
+
+// yispc: ahead-of-time compiler from a file of `define`s to a native module.
+//
+//   yispc rules.yisp -o rules.cpp     write the generated C++
+//   yispc rules.yisp -o rules.so      also compile it into a shared object
+//
+// Load the module with (load-native "rules.so"). Compiled functions are
+// registered as Proc cells in the global environment. Arithmetic and comparisons
+// on numbers are inlined, other primitives are called directly, and calls to
+// functions outside the module go through the interpreter, so interpreted and
+// compiled code can call each other. Calls between functions of the same module
+// are bound when the module is compiled. A define that uses a special form the
+// compiler does not handle (eval, delay, with-limits, nested define, set on a
+// non-parameter, ...) or calls a macro is kept as source and evaluated by the
+// interpreter when the module is loaded; so are the defmacro forms of the file.
+//---------------------------------------------------------------------------------------------------------------------------------------
+#ifndef YISP_SOURCE_DIR
+#define YISP_SOURCE_DIR "."
+#endif
+#ifndef YISP_CXX
+#define YISP_CXX "c++"
+#endif
+
+struct CompileError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Primitives that are called directly instead of being looked up
+const std::map<std::string, std::string> directPrimitives = {
+    { "and?", "procAnd" }, { "or?", "procOr" }, { "number?", "procNumber" }, { "symbol?", "procSymbol" },
+    { "list?", "procList" }, { "nil?", "procNil" }, { "not", "procNot" }, { "atom", "procAtom" },
+    { "car", "procCar" }, { "cdr", "procCdr" }, { "cons", "procCons" }, { "eq", "procEquals" },
+    { "=", "procEquals" }, { "gte", "procGreaterEqual" }, { ">=", "procGreaterEqual" },
+    { "lte", "procLessEqual" }, { "<=", "procLessEqual" },
+};
+
+// Numeric operators inlined as native long arithmetic, with the error thrown for non-numbers
+const std::map<std::string, std::pair<std::string, std::string>> numericOperators = {
+    { "add", { "yisp_add", "Non-numeric operand in addition" } }, { "+", { "yisp_add", "Non-numeric operand in addition" } },
+    { "sub", { "yisp_sub", "Non-numeric operand in subtraction" } }, { "-", { "yisp_sub", "Non-numeric operand in subtraction" } },
+    { "mul", { "yisp_mul", "Non-numeric operand in multiplication" } }, { "*", { "yisp_mul", "Non-numeric operand in multiplication" } },
+    { "div", { "yisp_div", "Non-numeric operand in division" } }, { "/", { "yisp_div", "Non-numeric operand in division" } },
+    { "mod", { "yisp_mod", "Non-numeric operand in %" } }, { "%", { "yisp_mod", "Non-numeric operand in %" } },
+};
+
+const std::map<std::string, std::string> comparisonOperators = {
+    { "gt", ">" }, { ">", ">" }, { "lt", "<" }, { "<", "<" },
+};
+
+// Special forms with a native translation; any other one keeps its define interpreted
+const std::set<std::string> compiledForms = { "quote", "if", "cond", "and", "or", "set" };
+
+std::string mangle(const std::string& name) {
+    std::string out;
+    for (unsigned char c : name) {
+        if (isalnum(c)) {
+            out += static_cast<char>(c);
+        } else {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "_%02x", c);
+            out += buf;
+        }
+    }
+    return out;
+}
+
+std::string cppString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+struct ModuleCompiler {
+    std::set<std::string> moduleFunctions;
+    std::set<std::string> macros;  // Defined by the file; calls to them are expanded by the interpreter
+    std::vector<std::string> constants;  // Source of each hoisted constant, read at registration
+    std::vector<std::string> params;
+
+    std::string constant(const std::string& source) {
+        for (size_t i = 0; i < constants.size(); i++) {
+            if (constants[i] == source) return "k" + std::to_string(i);
+        }
+        constants.push_back(source);
+        return "k" + std::to_string(constants.size() - 1);
+    }
+
+    bool isParam(const std::string& name) const {
+        return std::find(params.begin(), params.end(), name) != params.end();
+    }
+
+    std::string args(const CellPtr& expr, size_t from) {
+        std::string out = "{ ";
+        for (size_t i = from; i < expr->list().size(); i++) {
+            if (i > from) out += ", ";
+            out += cell(expr->list()[i]);
+        }
+        return out + " }";
+    }
+
+    // Expression producing a long; non-numbers throw `error` like the primitive would
+    std::string num(const CellPtr& expr, const std::string& error) {
+        if (expr->type == Number) return std::to_string(expr->number) + "L";
+        if (expr->type == List && !expr->list().empty() && expr->list()[0]->type == Symbol) {
+            auto op = numericOperators.find(expr->list()[0]->val());
+            if (op != numericOperators.end() && !isParam(op->first)) {
+                std::string out = op->second.first + "({ ";
+                for (size_t i = 1; i < expr->list().size(); i++) {
+                    if (i > 1) out += ", ";
+                    out += num(expr->list()[i], op->second.second);
+                }
+                return out + " })";
+            }
+        }
+        return "yisp_num(" + cell(expr) + ", " + cppString(error) + ")";
+    }
+
+    // Expression producing a bool, for conditions
+    std::string test(const CellPtr& expr) {
+        if (expr->type == List && expr->list().size() == 3 && expr->list()[0]->type == Symbol) {
+            auto op = comparisonOperators.find(expr->list()[0]->val());
+            if (op != comparisonOperators.end() && !isParam(op->first)) {
+                std::string error = op->second + " requires exactly two numeric operands";
+                return "(" + num(expr->list()[1], error) + " " + op->second + " " + num(expr->list()[2], error) + ")";
+            }
+        }
+        return "isTrue(" + cell(expr) + ")";
+    }
+
+    // Expression producing a CellPtr, with the same result as eval()
+    std::string cell(const CellPtr& expr) {
+        if (expr->type == Number) return constant(std::to_string(expr->number));
+        if (expr->type == String) return constant(toString(expr));
+        if (expr->type == Symbol) {
+            if (isParam(expr->val())) return "v_" + mangle(expr->val());
+            if (expr->val() == "t" || expr->val() == "nil") return constant(expr->val());
+            return "host.env->find(" + cppString(expr->val()) + ")";
+        }
+        if (expr->list().empty()) return constant("()");
+
+        CellPtr first = expr->list()[0];
+        if (first->type != Symbol) throw CompileError("call through a computed function");
+        const std::string& name = first->val();
+        if (isParam(name)) throw CompileError("call through a parameter");
+        if (macros.count(name)) throw CompileError("call to the macro " + name);
+        if (isSpecialForm(name) && !compiledForms.count(name)) throw CompileError(name);
+
+        if (name == "quote") {
+            if (expr->list().size() < 2) throw CompileError("malformed quote");
+            return constant(toString(expr->list()[1]));
+        }
+        if (name == "if") {
+            if (expr->list().size() < 3) throw CompileError("malformed if");
+            std::string otherwise = expr->list().size() > 3 ? cell(expr->list()[3]) : constant("nil");
+            return "(" + test(expr->list()[1]) + " ? " + cell(expr->list()[2]) + " : " + otherwise + ")";
+        }
+        if (name == "cond") {
+            std::string out = constant("nil");
+            for (size_t i = expr->list().size() - 1; i >= 1; i--) {
+                CellPtr clause = expr->list()[i];
+                if (clause->type != List || clause->list().size() != 2) throw CompileError("malformed cond");
+                out = "(" + test(clause->list()[0]) + " ? " + cell(clause->list()[1]) + " : " + out + ")";
+            }
+            return out;
+        }
+        if (name == "and" || name == "or") {
+            if (expr->list().size() != 3) throw CompileError("malformed " + name);
+            if (name == "and") return "(" + test(expr->list()[1]) + " ? " + cell(expr->list()[2]) + " : " + constant("nil") + ")";
+            return "(" + test(expr->list()[1]) + " ? " + constant("t") + " : " + cell(expr->list()[2]) + ")";
+        }
+        if (name == "set") {
+            if (expr->list().size() != 3 || !isParam(expr->list()[1]->val())) throw CompileError("set on a non-parameter");
+            return "(v_" + mangle(expr->list()[1]->val()) + " = " + cell(expr->list()[2]) + ")";
+        }
+        if (numericOperators.count(name)) {
+            return "makeNumber(" + num(expr, numericOperators.at(name).second) + ")";
+        }
+        if (comparisonOperators.count(name) && expr->list().size() == 3) {
+            return "(" + test(expr) + " ? " + constant("t") + " : " + constant("nil") + ")";
+        }
+        if (moduleFunctions.count(name)) return "fn_" + mangle(name) + "(" + args(expr, 1) + ")";
+        if (directPrimitives.count(name)) return directPrimitives.at(name) + "(" + args(expr, 1) + ")";
+        return "callGlobal(" + cppString(name) + ", " + args(expr, 1) + ")";
+    }
+
+    std::string function(const std::string& name, const CellPtr& paramList, const CellPtr& body) {
+        params.clear();
+        for (auto& p : paramList->list()) {
+            if (p->type != Symbol) throw CompileError("non-symbol parameter");
+            params.push_back(p->val());
+        }
+        std::string code = cell(body);
+
+        std::ostringstream out;
+        out << "CellPtr fn_" << mangle(name) << "(const Cells& args) {\n"
+            << "    if (args.size() != " << params.size() << ") {\n"
+            << "        throw std::runtime_error(\"Argument count mismatch\");\n"
+            << "    }\n";
+        for (size_t i = 0; i < params.size(); i++) {
+            out << "    CellPtr v_" << mangle(params[i]) << " = args[" << i << "];\n";
+        }
+        out << "    return " << code << ";\n}\n\n";
+        return out.str();
+    }
+};
+
+bool isDefinition(const CellPtr& form, const std::string& keyword) {
+    return form->type == List && form->list().size() == 4 && form->list()[0]->type == Symbol &&
+           form->list()[0]->val() == keyword && form->list()[1]->type == Symbol && form->list()[2]->type == List;
+}
+
+bool isDefine(const CellPtr& form) {
+    return isDefinition(form, "define");
+}
+
+std::string compileModule(const std::vector<CellPtr>& forms, const std::string& sourceName) {
+    ModuleCompiler compiler;
+    for (auto& form : forms) {
+        if (isDefinition(form, "defmacro")) {
+            compiler.macros.insert(form->list()[1]->val());
+        } else if (isDefine(form)) {
+            compiler.moduleFunctions.insert(form->list()[1]->val());
+        } else {
+            throw std::runtime_error("yispc only compiles define and defmacro forms, found: " + toString(form));
+        }
+    }
+
+    // Find the defines that cannot be compiled; they stay interpreted
+    std::vector<std::pair<std::string, bool>> registrations;  // name or source, compiled
+    for (auto& form : forms) {
+        if (!isDefine(form)) {
+            registrations.push_back({ toString(form), false });
+            continue;
+        }
+        const std::string& name = form->list()[1]->val();
+        try {
+            compiler.function(name, form->list()[2], form->list()[3]);
+            registrations.push_back({ name, true });
+        } catch (const CompileError& e) {
+            std::cerr << "yispc: " << name << " stays interpreted (" << e.what() << ")" << std::endl;
+            compiler.moduleFunctions.erase(name);
+            registrations.push_back({ toString(form), false });
+        }
+    }
+    // Functions that fell back are called through the environment, so compile again without them
+    compiler.constants.clear();
+    std::vector<std::string> bodies;
+    for (auto& form : forms) {
+        if (isDefine(form) && compiler.moduleFunctions.count(form->list()[1]->val())) {
+            bodies.push_back(compiler.function(form->list()[1]->val(), form->list()[2], form->list()[3]));
+        }
+    }
+
+    std::ostringstream out;
+    out << "// Generated by yispc from " << sourceName << ". Do not edit.\n"
+        << "#define YISP_NO_MAIN\n"
+        << "#define YISP_MODULE\n"
+        << "#include \"lisp.cpp\"\n\n"
+        << "namespace {\n\n"
+        << "YispModuleHost host;\n";
+    for (size_t i = 0; i < compiler.constants.size(); i++) out << "CellPtr k" << i << ";\n";
+    out << "\n"
+        << "long yisp_num(const CellPtr& c, const char* error) {\n"
+        << "    if (c->type != Number) throw std::runtime_error(error);\n"
+        << "    return c->number;\n"
+        << "}\n\n"
+        << "long yisp_add(std::initializer_list<long> xs) { long r = 0; for (long x : xs) r += x; return r; }\n"
+        << "long yisp_mul(std::initializer_list<long> xs) { long r = 1; for (long x : xs) r *= x; return r; }\n"
+        << "long yisp_sub(std::initializer_list<long> xs) {\n"
+        << "    if (xs.size() == 0) throw std::runtime_error(\"Subtraction requires at least one operand\");\n"
+        << "    if (xs.size() == 1) return -*xs.begin();\n"
+        << "    long r = *xs.begin();\n"
+        << "    for (auto it = xs.begin() + 1; it != xs.end(); ++it) r -= *it;\n"
+        << "    return r;\n"
+        << "}\n"
+        << "long yisp_div(std::initializer_list<long> xs) {\n"
+        << "    if (xs.size() < 2) throw std::runtime_error(\"Division requires at least two operands\");\n"
+        << "    long r = *xs.begin();\n"
+        << "    for (auto it = xs.begin() + 1; it != xs.end(); ++it) {\n"
+        << "        if (*it == 0) throw std::runtime_error(\"Division by zero\");\n"
+        << "        r /= *it;\n"
+        << "    }\n"
+        << "    return r;\n"
+        << "}\n"
+        << "long yisp_mod(std::initializer_list<long> xs) {\n"
+        << "    if (xs.size() != 2) throw std::runtime_error(\"% requires exactly two arguments\");\n"
+        << "    if (*(xs.begin() + 1) == 0) throw std::runtime_error(\"Division by zero in %\");\n"
+        << "    return *xs.begin() % *(xs.begin() + 1);\n"
+        << "}\n\n"
+        << "CellPtr callGlobal(const std::string& name, const Cells& args) {\n"
+        << "    CellPtr func = host.env->find(name);\n"
+        << "    if (func->type == Macro) throw std::runtime_error(\"Macro called from compiled code: \" + name);\n"
+        << "    return host.apply(func, args);\n"
+        << "}\n\n";
+    for (auto& r : registrations) {
+        if (r.second) out << "CellPtr fn_" << mangle(r.first) << "(const Cells& args);\n";
+    }
+    out << "\n";
+    for (auto& body : bodies) out << body;
+    out << "}  // namespace\n\n"
+        << "extern \"C\" __attribute__((visibility(\"default\"))) int yisp_module_register(const YispModuleHost& h) {\n"
+        << "    host = h;\n";
+    for (size_t i = 0; i < compiler.constants.size(); i++) {
+        out << "    k" << i << " = read(" << cppString(compiler.constants[i]) << ");\n";
+    }
+    int compiled = 0;
+    for (auto& r : registrations) {
+        if (r.second) {
+            out << "    host.env->define(" << cppString(r.first) << ", std::make_shared<Cell>(fn_" << mangle(r.first) << "));\n";
+            compiled++;
+        } else {
+            out << "    host.eval(read(" << cppString(r.first) << "), host.env);\n";
+        }
+    }
+    out << "    return " << compiled << ";\n}\n";
+    return out.str();
+}
+
+// Runs the C++ compiler on the generated source without a shell, so no path needs quoting.
+// The exit status of the compiler, or -1 when it could not be started.
+int runCompiler(const std::string& cppPath, const std::string& output) {
+    std::vector<std::string> argv = { YISP_CXX, "-std=c++17", "-O2", "-fPIC", "-shared", "-fvisibility=hidden",
+                                      std::string("-I") + YISP_SOURCE_DIR, cppPath, "-o", output };
+    std::vector<char*> args;
+    for (auto& a : argv) args.push_back(&a[0]);
+    args.push_back(nullptr);
+
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        execvp(args[0], args.data());
+        _exit(127);
+    }
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) return -1;
+    if (WIFEXITED(status) && WEXITSTATUS(status) != 127) return WEXITSTATUS(status);
+    return -1;
+}
+
+bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string input;
+    std::string output;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) output = argv[++i];
+        else input = arg;
+    }
+    if (input.empty() || output.empty()) {
+        std::cerr << "usage: yispc file.yisp -o file.cpp|file.so" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(input);
+    if (!in) {
+        std::cerr << "yispc: cannot read " << input << std::endl;
+        return 1;
+    }
+    std::stringstream source;
+    source << in.rdbuf();
+
+    std::string code;
+    try {
+        code = compileModule(readAll(source.str()), input);
+    } catch (const std::exception& e) {
+        std::cerr << "yispc: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::string cppPath = endsWith(output, ".so") ? output + ".cpp" : output;
+    {
+        std::ofstream out(cppPath);
+        out << code;
+    }
+    if (!endsWith(output, ".so")) return 0;
+
+    int rc = runCompiler(cppPath, output);
+    std::remove(cppPath.c_str());
+    if (rc != 0) {
+        std::cerr << "yispc: compiling the module failed: " << (rc < 0 ? "cannot run " : "") << YISP_CXX << std::endl;
+        return 1;
+    }
+    return 0;
+}